@@ -0,0 +1,233 @@
+/***************************************************************************
+ *  include/auv_controls/command_trace_collector_node.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_AUVCONTROLS_COMMANDTRACECOLLECTOR
+#define USCAUV_AUVCONTROLS_COMMANDTRACECOLLECTOR
+
+// ROS
+#include <ros/ros.h>
+
+// uscauv
+#include <uscauv_common/base_node.h>
+#include <uscauv_common/param_loader.h>
+#include <uscauv_common/command_trace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <sstream>
+#include <iomanip>
+
+/**
+ * Collects finished command traces (see auv_msgs/CommandTrace) and periodically prints latency
+ * percentiles for every hop along the command chain, and which one dominates.
+ *
+ * Each trace is split into segments: the time a node spent on the command (e.g. "control_server"),
+ * and the time it took to get from one node to the next (e.g. "control_server -> thruster_mapper").
+ * In the control server this includes waiting for the next control cycle.
+ *
+ * Traces end at the seabee3 adapter (or the control chain, which publishes on the adapter's topic).
+ * The time from there to the thruster writes in the driver is not covered.
+ */
+class CommandTraceCollectorNode: public BaseNode
+{
+ private:
+  struct Segment
+  {
+    std::string name_;
+    /// latest latencies, in seconds
+    std::deque<double> samples_;
+  };
+
+  /// in the order they were first seen, which is the order of the chain
+  std::vector<Segment> segments_;
+  Segment end_to_end_;
+  
+  unsigned int window_size_;
+  double report_period_;
+  unsigned int traces_since_report_;
+  ros::Time last_report_;
+
+  /// ROS
+  ros::NodeHandle nh_rel_;
+  ros::Subscriber command_trace_sub_;
+  
+ public:
+ CommandTraceCollectorNode(): BaseNode("CommandTraceCollector"),
+    window_size_( 1000 ), report_period_( 10.0 ), traces_since_report_( 0 ),
+    nh_rel_("~")
+    {
+      end_to_end_.name_ = "end to end";
+    }
+
+ private:
+
+  // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
+  void spinFirst()
+  {
+    ros::NodeHandle nh;
+    
+    window_size_ = uscauv::param::load<int>( nh_rel_, "window_size", 1000 );
+    report_period_ = uscauv::param::load<double>( nh_rel_, "report_period", 10.0 );
+
+    command_trace_sub_ = nh.subscribe( "command_trace", 100, &CommandTraceCollectorNode::commandTraceCallback, this );
+    last_report_ = ros::Time::now();
+  }  
+
+  // Running spin() will cause this function to get called at the loop rate until this node is killed.
+  void spinOnce()
+  {
+    ros::Time const now = ros::Time::now();
+    if( ( now - last_report_ ).toSec() < report_period_ )
+      return;
+
+    last_report_ = now;
+    if( !traces_since_report_ )
+      {
+	ROS_INFO( "No command traces received in the last %.1f seconds.", report_period_ );
+	return;
+      }
+
+    report();
+    traces_since_report_ = 0;
+  }
+
+  void commandTraceCallback( uscauv::_CommandTraceMsg::ConstPtr const & msg )
+  {
+    if( !uscauv::isTraced( *msg ) || msg->hops.empty() )
+      return;
+
+    ros::Time previous_sent = msg->origin;
+    std::string previous_name = "sender";
+    
+    for( uscauv::_CommandHopMsg const & hop : msg->hops )
+      {
+	std::string const name = uscauv::getCommandStageName( hop.stage );
+	
+	addSample( previous_name + " -> " + name, ( hop.received - previous_sent ).toSec() );
+	addSample( name, ( hop.sent - hop.received ).toSec() );
+
+	previous_sent = hop.sent;
+	previous_name = name;
+      }
+
+    addSample( end_to_end_, ( msg->hops.back().sent - msg->origin ).toSec() );
+    ++traces_since_report_;
+  }
+
+  void addSample( std::string const & name, double const & latency )
+  {
+    for( Segment & segment : segments_ )
+      {
+	if( segment.name_ == name )
+	  {
+	    addSample( segment, latency );
+	    return;
+	  }
+      }
+
+    segments_.push_back( Segment() );
+    segments_.back().name_ = name;
+    addSample( segments_.back(), latency );
+  }
+
+  void addSample( Segment & segment, double const & latency )
+  {
+    segment.samples_.push_back( latency );
+    while( segment.samples_.size() > window_size_ )
+      segment.samples_.pop_front();
+  }
+
+  /// Nearest rank percentile of sorted samples
+  static double percentile( std::vector<double> const & sorted, double const & fraction )
+  {
+    unsigned int const rank = std::ceil( fraction * sorted.size() );
+    return sorted[ std::min<unsigned int>( std::max<unsigned int>( rank, 1 ), sorted.size() ) - 1 ];
+  }
+
+  /** 
+   * @param report Row for the segment is added to this
+   * 
+   * @return Median latency of the segment, in seconds
+   */
+  static double reportSegment( Segment const & segment, std::stringstream & report )
+  {
+    std::vector<double> sorted( segment.samples_.begin(), segment.samples_.end() );
+    std::sort( sorted.begin(), sorted.end() );
+
+    double const median = percentile( sorted, 0.5 );
+    report << std::endl << std::setw( 40 ) << segment.name_ << std::fixed << std::setprecision( 3 )
+	   << std::setw( 10 ) << median * 1e3
+	   << std::setw( 10 ) << percentile( sorted, 0.9 ) * 1e3
+	   << std::setw( 10 ) << percentile( sorted, 0.99 ) * 1e3
+	   << std::setw( 10 ) << sorted.back() * 1e3;
+    return median;
+  }
+
+  void report()
+  {
+    std::stringstream report;
+    report << "Command latency over the last " << end_to_end_.samples_.size() << " traces ( "
+	   << traces_since_report_ << " new ), in ms:" << std::endl
+	   << std::setw( 40 ) << "" << std::setw( 10 ) << "p50" << std::setw( 10 ) << "p90"
+	   << std::setw( 10 ) << "p99" << std::setw( 10 ) << "max";
+
+    Segment const * dominant = NULL;
+    double dominant_median = -1;
+    for( Segment const & segment : segments_ )
+      {
+	double const median = reportSegment( segment, report );
+	if( median > dominant_median )
+	  {
+	    dominant = &segment;
+	    dominant_median = median;
+	  }
+      }
+    double const total_median = reportSegment( end_to_end_, report );
+    
+    ROS_INFO_STREAM( report.str() );
+    
+    if( dominant && total_median > 0 )
+      ROS_INFO( "Slowest hop is [ %s ], %.0f%% of the median end to end latency.",
+		dominant->name_.c_str(), 100 * dominant_median / total_median );
+  }
+  
+};
+
+#endif // USCAUV_AUVCONTROLS_COMMANDTRACECOLLECTOR
@@ -0,0 +1,276 @@
+/***************************************************************************
+ *  include/auv_controls/control_chain_node.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_AUVCONTROLS_CONTROLCHAIN
+#define USCAUV_AUVCONTROLS_CONTROLCHAIN
+
+// ROS
+#include <ros/ros.h>
+
+// uscauv
+#include <uscauv_common/param_loader.h>
+
+#include <auv_controls/control_server_node.h>
+#include <auv_controls/seabee3_adapter_node.h>
+#include <auv_physics/thruster_mapper_node.h>
+
+#include <ros/callback_queue.h>
+
+#include <chrono>
+
+/**
+ * Runs the control server, the thruster mapper and the seabee3 adapter in one process. Each loop
+ * computes the control output, allocates it to the thrusters and fills in the motor values
+ * synchronously, so a command reaches the driver in the same cycle it was computed in.
+ *
+ * The intermediate topics (axis_out, motor_levels) are only published if ~publish_stages is set.
+ * thruster_wrench is always published, since the physics simulator runs off of it.
+ * Use seabee3_controls.launch with split:=true to run the nodes separately.
+ *
+ * The thruster model's reconfigure requests are queued and applied at the start of a cycle, so they
+ * never race with the allocation when the loop runs on the control thread.
+ *
+ * A traced axis command gets the same hops it would get from the separate nodes: control for the
+ * control server, allocation for the mapper and mapping for the adapter. The finished trace goes
+ * out on ~command_trace, same as from the adapter.
+ */
+class ControlChainNode: public ControlServerNode
+{
+ private:
+  typedef std::chrono::steady_clock _Clock;
+  
+  enum Stages { CONTROL, ALLOCATION, MAPPING, PUBLISH, NUM_STAGES };
+  
+  struct StageTiming
+  {
+    double total_us_, max_us_;
+  };
+  
+  /// has to be constructed before the model and model_reconfigure_
+  ros::CallbackQueue model_callback_queue_;
+  _ThrusterAxisModel thruster_axis_model_;
+  MultiReconfigure model_reconfigure_;
+  _ThrusterAxisModel::ThrusterVector motor_powers_;
+
+  /// Motor controller ID for each thruster index, or -1 if it isn't mapped
+  std::vector<int> motor_ids_;
+  _MotorValsMsg motor_vals_;
+
+  bool publish_stages_;
+  double timing_report_period_;
+  
+  StageTiming stage_timing_[ NUM_STAGES ];
+  unsigned int timed_cycles_;
+  _Clock::time_point last_timing_report_;
+
+  /// ROS
+  ros::Publisher motor_vals_pub_, motor_levels_pub_, wrench_pub_, command_trace_pub_;
+  
+ public:
+ ControlChainNode(): thruster_axis_model_( "model/thrusters", &model_callback_queue_ ),
+    model_reconfigure_( _ThrusterAxisModel::queuedNodeHandle( "~", &model_callback_queue_ ) ),
+    publish_stages_( false ), timing_report_period_( 10.0 ), timed_cycles_( 0 )
+    {
+      resetTiming();
+    }
+
+  /// The control thread calls into this class, so it has to stop first
+  ~ControlChainNode()
+  {
+    control_thread_.stop();
+  }
+
+ private:
+
+  // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
+  void spinFirst()
+  {
+    ControlServerNode::spinFirst();
+    
+    publish_stages_ = uscauv::param::load<bool>( nh_rel_, "publish_stages", false );
+    timing_report_period_ = uscauv::param::load<double>( nh_rel_, "timing_report_period", 10.0 );
+
+    motor_vals_pub_ = nh_rel_.advertise<_MotorValsMsg>( "motor_vals", 10 );
+    wrench_pub_ = nh_rel_.advertise<geometry_msgs::Wrench>( "thruster_wrench", 10 );
+    command_trace_pub_ = nh_rel_.advertise<uscauv::_CommandTraceMsg>( "command_trace", 10 );
+    if( publish_stages_ )
+      motor_levels_pub_ = nh_rel_.advertise<_MotorPowerArrayMsg>( "motor_levels", 10 );
+    
+    thruster_axis_model_.load("robot/thrusters");
+
+    /// the model has to be loaded first, the callback gets called right away
+    model_reconfigure_.addReconfigureServer<_ThrusterAllocationConfig>("allocation", &ControlChainNode::allocationCallback, this );
+
+    updateMotorIds();
+    last_timing_report_ = _Clock::now();
+  }  
+
+  /// Called from the control thread if there is one, otherwise from spinOnce()
+  void runControlCycle( ControlInputs const & inputs )
+  {
+    /// thruster and allocation reconfigures
+    model_callback_queue_.callAvailable();
+    
+    _Clock::time_point stage_end[ NUM_STAGES + 1 ];
+    stage_end[ 0 ] = _Clock::now();
+    
+    bool const traced = takeCommandTrace( inputs );
+    ros::Time hop_end[ MAPPING + 1 ];
+    
+    AxisValueVector const control = computeControl( inputs );
+    stage_end[ CONTROL + 1 ] = _Clock::now();
+    if( traced )
+      hop_end[ CONTROL ] = ros::Time::now();
+
+    thruster_axis_model_.AxisToMotorPowers( control, motor_powers_ );
+    stage_end[ ALLOCATION + 1 ] = _Clock::now();
+    if( traced )
+      hop_end[ ALLOCATION ] = ros::Time::now();
+
+    if( motor_ids_.size() != (unsigned int) motor_powers_.rows() )
+      updateMotorIds();
+    
+    for( unsigned int idx = 0; idx < motor_ids_.size(); ++idx )
+      {
+	if( motor_ids_[ idx ] >= 0 )
+	  motor_vals_.motors[ motor_ids_[ idx ] ] = motor_powers_( idx );
+      }
+    stage_end[ MAPPING + 1 ] = _Clock::now();
+
+    if( traced )
+      {
+	hop_end[ MAPPING ] = ros::Time::now();
+	
+	inputs.command_trace_.toMsg( motor_vals_.trace );
+	uscauv::appendCommandHop( motor_vals_.trace, uscauv::_CommandHopMsg::CONTROL_SERVER, inputs.command_received_, hop_end[ CONTROL ] );
+	uscauv::appendCommandHop( motor_vals_.trace, uscauv::_CommandHopMsg::THRUSTER_MAPPER, hop_end[ CONTROL ], hop_end[ ALLOCATION ] );
+	uscauv::appendCommandHop( motor_vals_.trace, uscauv::_CommandHopMsg::SEABEE3_ADAPTER, hop_end[ ALLOCATION ], hop_end[ MAPPING ] );
+      }
+    
+    motor_vals_pub_.publish( motor_vals_ );
+    stage_end[ PUBLISH + 1 ] = _Clock::now();
+
+    /// only the first cycle after a command carries its trace
+    if( traced )
+      {
+	command_trace_pub_.publish( motor_vals_.trace );
+	motor_vals_.trace.id = 0;
+	motor_vals_.trace.hops.clear();
+      }
+
+    /// not timed, the driver doesn't wait on these
+    wrench_pub_.publish( _ThrusterAxisModel::AxisToWrenchMsg( thruster_axis_model_.MotorPowersToAxis( motor_powers_ ) ) );
+    if( publish_stages_ )
+      {
+	axis_pub_.publish( axisToTwistMsg( control ) );
+	motor_levels_pub_.publish( thruster_axis_model_.MotorPowersToMotorArray( motor_powers_ ) );
+      }
+
+    recordTiming( stage_end );
+  }
+
+  void allocationCallback( _ThrusterAllocationConfig const & config )
+  {
+    thruster_axis_model_.setAllocationParams
+      ( _ThrusterAxisModel::constructAxisVector( config.weight_x, config.weight_y, config.weight_z,
+						 config.weight_roll, config.weight_pitch, config.weight_yaw ),
+	config.max_power, config.regularization );
+  }
+
+  /// Resolve the model's thrusters to motor controller IDs. Unmapped motor values are masked off.
+  void updateMotorIds()
+  {
+    std::vector<std::string> const & names = thruster_axis_model_.getActiveThrusterNames();
+    
+    motor_ids_.clear();
+    motor_vals_ = _MotorValsMsg();
+    
+    for( std::string const & name : names )
+      {
+	int const motor_id = getMotorControllerId( name );
+	motor_ids_.push_back( motor_id );
+	if( motor_id >= 0 )
+	  motor_vals_.mask[ motor_id ] = true;
+      }
+  }
+
+  void recordTiming( _Clock::time_point const * stage_end )
+  {
+    for( unsigned int stage = 0; stage < NUM_STAGES; ++stage )
+      {
+	double const us = std::chrono::duration<double, std::micro>( stage_end[ stage + 1 ] - stage_end[ stage ] ).count();
+	stage_timing_[ stage ].total_us_ += us;
+	stage_timing_[ stage ].max_us_ = std::max( stage_timing_[ stage ].max_us_, us );
+      }
+    ++timed_cycles_;
+
+    _Clock::time_point const & now = stage_end[ NUM_STAGES ];
+    if( timing_report_period_ <= 0 || std::chrono::duration<double>( now - last_timing_report_ ).count() < timing_report_period_ )
+      return;
+    
+    static char const * const stage_names[ NUM_STAGES ] = { "control", "allocation", "mapping", "publish" };
+    
+    std::stringstream report;
+    double total_us = 0;
+    for( unsigned int stage = 0; stage < NUM_STAGES; ++stage )
+      {
+	double const mean_us = stage_timing_[ stage ].total_us_ / timed_cycles_;
+	total_us += mean_us;
+	report << " " << stage_names[ stage ] << " " << mean_us << " (max " << stage_timing_[ stage ].max_us_ << ")";
+      }
+    ROS_INFO_STREAM( "Control chain over " << timed_cycles_ << " cycles, mean us:" << report.str() << 
+		     ", total " << total_us << "." );
+
+    resetTiming();
+    last_timing_report_ = now;
+  }
+
+  void resetTiming()
+  {
+    for( unsigned int stage = 0; stage < NUM_STAGES; ++stage )
+      {
+	stage_timing_[ stage ].total_us_ = 0;
+	stage_timing_[ stage ].max_us_ = 0;
+      }
+    timed_cycles_ = 0;
+  }
+  
+};
+
+#endif // USCAUV_AUVCONTROLS_CONTROLCHAIN
@@ -46,15 +46,20 @@
 #include <uscauv_common/base_node.h>
 #include <uscauv_common/multi_reconfigure.h>
 #include <uscauv_common/defaults.h>
+#include <uscauv_common/param_loader.h>
+#include <uscauv_common/command_trace.h>
 
 #include <auv_controls/ControlServerConfig.h>
 #include <auv_controls/controller.h>
+#include <auv_controls/control_thread.h>
+#include <auv_controls/LoopTiming.h>
 
 #include <tf/transform_listener.h>
 /* #include <auv_physics/thruster_axis_model.h> */
 
 #include <auv_msgs/MaskedTwist.h>
 #include <auv_msgs/MotorPowerArray.h>
+#include <auv_msgs/TracedTwist.h>
 #include <geometry_msgs/Twist.h>
 
 #include <eigen_conversions/eigen_msg.h>
@@ -64,15 +69,34 @@ static std::string const MEASUREMENT_FRAME_NAME = uscauv::defaults::MEASUREMENT_
 
 typedef auv_controls::ControlServerConfig _ControlServerConfig;
 
-class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
+class ControlServerNode: public BaseNode, public uscauv::PID6D, public MultiReconfigure
 {
  public:
   typedef Eigen::Matrix<double, 6, 1> AxisValueVector;
   typedef Eigen::Matrix<bool, 6, 1> AxisMaskVector;
+
+  /// Everything a control cycle needs from the ROS side. Plain data, so that it can be handed to the control thread.
+  struct ControlInputs
+  {
+    AxisValueVector pose_error_;
+    AxisValueVector axis_command_;
+    double pose_scale_linear_, pose_scale_angular_;
+    /// time of the measurement that pose_error_ was computed from. The PIDs only update when it changes.
+    ros::Time measurement_stamp_;
+    /// when that measurement got here on the monotonic clock, which the PIDs take dt from
+    uscauv::PID6D::_Clock::time_point measurement_arrival_;
+    /// depth and forward speed of the measurement, for gain scheduling
+    ScheduleVector schedule_variables_;
+    /// latest traced axis command, and when it got here
+    uscauv::CommandTraceData command_trace_;
+    ros::Time command_received_;
+  };
  private:
   typedef auv_msgs::MaskedTwist _MaskedTwistMsg;
+  typedef auv_msgs::TracedTwist _TracedTwistMsg;
+  typedef auv_controls::LoopTiming _LoopTimingMsg;
   
- private:
+ protected:
 
   /* uscauv::ReconfigurableThrusterAxisModel<uscauv::ThrusterModelSimpleLookup> thruster_axis_model_; */
 
@@ -81,19 +105,72 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
   AxisValueVector axis_command_value_; /* pose_command_value_; */
   AxisMaskVector axis_command_mask_;
 
+  /// latest inputs, written on the ROS thread
+  ControlInputs control_inputs_;
+  bool axis_command_changed_;
+
+  /**
+   * By default the pose error and PIDs are updated when tf gets a new measurement, instead of
+   * every tick. If measurements stop for measurement_timeout_ seconds (e.g. in simulation), the
+   * error is looked up every tick instead, the way it used to be.
+   */
+  bool event_driven_pose_, measurements_stale_;
+  double measurement_timeout_;
+  ros::Time last_measurement_stamp_, last_measurement_arrival_;
+
+  /// previous measured pose, to estimate forward speed for gain scheduling
+  tf::StampedTransform last_measurement_tf_;
+  bool has_last_measurement_tf_;
+  /// time constant of the low-pass filter on the forward speed
+  double speed_filter_;
+
+  /// owned by whichever thread runs the control cycle
+  AxisValueVector pose_control_;
+  ros::Time pid_stamp_;
+  /// id of the last command trace that was passed on, so that each trace goes out once
+  unsigned int last_command_trace_;
+
+  /// Optional control thread, so that slow ROS callbacks don't delay the control loop
+  bool use_control_thread_;
+  uscauv::ControlThread control_thread_;
+  uscauv::DoubleBuffer<ControlInputs> control_inputs_buffer_;
+  /// control thread's copy of the inputs
+  ControlInputs thread_inputs_;
+  unsigned int loop_timing_version_;
+
   /// ROS
   ros::NodeHandle nh_rel_;
   ros::Subscriber axis_command_sub_;
-  ros::Publisher axis_pub_;
+  ros::Publisher axis_pub_, axis_traced_pub_, loop_timing_pub_;
   tf::TransformListener tf_listener_;
   
  public:
  ControlServerNode(): BaseNode("ControlServer"), /* thruster_axis_model_("model/thrusters"),  */
     axis_command_value_( AxisValueVector::Zero() ), /* pose_command_value_( AxisValueVector::Zero() ), */
     axis_command_mask_( AxisMaskVector::Zero() ),
-    nh_rel_("~") {}
+    axis_command_changed_( false ),
+    event_driven_pose_( true ), measurements_stale_( true ), measurement_timeout_( 0.5 ),
+    has_last_measurement_tf_( false ), speed_filter_( 0.5 ),
+    pose_control_( AxisValueVector::Zero() ), last_command_trace_( 0 ),
+    use_control_thread_( false ), loop_timing_version_( 0 ),
+    nh_rel_("~"),
+    /// process tf on the ROS thread, so that measurement events arrive there
+    tf_listener_( ros::Duration( tf::Transformer::DEFAULT_CACHE_TIME ), false )
+    {
+      control_inputs_.pose_error_ = AxisValueVector::Zero();
+      control_inputs_.axis_command_ = AxisValueVector::Zero();
+      control_inputs_.pose_scale_linear_ = control_inputs_.pose_scale_angular_ = 0;
+      control_inputs_.schedule_variables_ = ScheduleVector::Zero();
+      thread_inputs_ = control_inputs_;
+    }
+
+  /// The control thread calls into this class, so it has to stop first
+  ~ControlServerNode()
+  {
+    control_thread_.stop();
+  }
 
- private:
+ protected:
 
   // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
   void spinFirst()
@@ -101,6 +178,8 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
     axis_command_sub_ = nh_rel_.subscribe( "axis_cmd", 10, &ControlServerNode::axisCommandCallback, this );
 
     axis_pub_ = nh_rel_.advertise<geometry_msgs::Twist>( "axis_out", 10 );
+    /// axis_out is a plain twist, so the output goes out again here with its command trace attached
+    axis_traced_pub_ = nh_rel_.advertise<_TracedTwistMsg>( "axis_out_traced", 10 );
        
     addReconfigureServer<_ControlServerConfig>( "scale" );
     config_ = &getLatestConfig<_ControlServerConfig>("scale");
@@ -111,28 +190,183 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
     /// Load PIDs
     loadController();
 
-    setObserved<PID6D::Axes::SURGE> (0.0f);
-    setObserved<PID6D::Axes::SWAY>  (0.0f);
-    setObserved<PID6D::Axes::HEAVE> (0.0f);
-    setObserved<PID6D::Axes::ROLL>  (0.0f);
-    setObserved<PID6D::Axes::PITCH> (0.0f);
-    setObserved<PID6D::Axes::YAW>   (0.0f);
+    /// the setpoint is the pose error, so the observed value is always zero
+    setObserved( AxisValueVector::Zero() );
+    if( hasSchedule() )
+      speed_filter_ = uscauv::param::load<double>( nh_rel_, "pid/speed_filter", 0.5 );
+
+    use_control_thread_ = uscauv::param::load<bool>( nh_rel_, "control_thread", false );
+    if( use_control_thread_ )
+      loop_timing_pub_ = nh_rel_.advertise<_LoopTimingMsg>( "loop_timing", 10 );
+
+    event_driven_pose_ = uscauv::param::load<bool>( nh_rel_, "event_driven_pose", true );
+    measurement_timeout_ = uscauv::param::load<double>( nh_rel_, "measurement_timeout", 0.5 );
+    if( event_driven_pose_ )
+      tf_listener_.addTransformsChangedListener( boost::bind( &ControlServerNode::transformsChangedCallback, this ) );
   }  
 
   // Running spin() will cause this function to get called at the loop rate until this node is killed.
   void spinOnce()
   {
-    /// get latest transforms
-    updatePoseCommand();
+    bool const stale = !event_driven_pose_ ||
+      ( ros::Time::now() - last_measurement_arrival_ ).toSec() > measurement_timeout_;
+
+    if( event_driven_pose_ && stale != measurements_stale_ )
+      {
+	if( stale )
+	  ROS_WARN( "No new measurements for %.2f seconds. Updating the pose error every tick.", measurement_timeout_ );
+	else
+	  ROS_INFO( "Receiving measurements. Updating the pose error on each measurement." );
+      }
+    measurements_stale_ = stale;
+    
+    /// get latest transforms. Like the event path, skip the cycle if they aren't available.
+    if( stale )
+      {
+	if( updatePoseCommand( ros::Time(0) ) )
+	  {
+	    /// same time base as the tf stamps on the event path, dt comes from the monotonic clock either way
+	    control_inputs_.measurement_stamp_ = ros::Time::now();
+	    control_inputs_.measurement_arrival_ = uscauv::PID6D::_Clock::now();
+	    sendControlInputs();
+	  }
+      }
+    /// measurements drive the loop, but axis commands shouldn't have to wait for one
+    else if( axis_command_changed_ || use_control_thread_ )
+      sendControlInputs();
+
+    if( !use_control_thread_ )
+      return;
+
+    /// started here rather than in spinFirst(), so that derived classes are done setting up
+    if( !control_thread_.running() )
+      startControlThread();
+
+    publishLoopTiming();
+  }
+
+  /// Called by tf whenever it receives transforms, on the ROS thread
+  void transformsChangedCallback()
+  {
+    ros::Time stamp;
+    if( tf_listener_.getLatestCommonTime( "/world", MEASUREMENT_FRAME_NAME, stamp, NULL ) != tf::NO_ERROR ||
+	stamp <= last_measurement_stamp_ )
+      return;
+
+    last_measurement_stamp_ = stamp;
+    last_measurement_arrival_ = ros::Time::now();
+    
+    if( measurements_stale_ || !updatePoseCommand( stamp ) )
+      return;
+
+    control_inputs_.measurement_stamp_ = stamp;
+    control_inputs_.measurement_arrival_ = uscauv::PID6D::_Clock::now();
+    sendControlInputs();
+  }
+
+  /// Run a control cycle with the latest inputs, or hand them to the control thread
+  void sendControlInputs()
+  {
+    control_inputs_.axis_command_ = axis_command_value_;
+    control_inputs_.pose_scale_linear_ = config_->pose_scale_linear;
+    control_inputs_.pose_scale_angular_ = config_->pose_scale_angular;
+    axis_command_changed_ = false;
+    
+    if( use_control_thread_ )
+      control_inputs_buffer_.write( control_inputs_ );
+    else
+      runControlCycle( control_inputs_ );
+  }
+
+  /// Run one cycle of the loop and send the output. Called from the control thread if there is one.
+  virtual void runControlCycle( ControlInputs const & inputs )
+  {
+    AxisValueVector const control = computeControl( inputs );
+
+    _TracedTwistMsg traced_twist;
+    traced_twist.twist = axisToTwistMsg( control );
+
+    if( takeCommandTrace( inputs ) )
+      {
+	inputs.command_trace_.toMsg( traced_twist.trace );
+	uscauv::appendCommandHop( traced_twist.trace, uscauv::_CommandHopMsg::CONTROL_SERVER, inputs.command_received_ );
+      }
+    
+    axis_pub_.publish( traced_twist.twist );
+    axis_traced_pub_.publish( traced_twist );
+  }
+
+  /// True the first time a cycle sees a traced command, which is the cycle that passes it on
+  bool takeCommandTrace( ControlInputs const & inputs )
+  {
+    if( !inputs.command_trace_.id_ || inputs.command_trace_.id_ == last_command_trace_ )
+      return false;
+
+    last_command_trace_ = inputs.command_trace_.id_;
+    return true;
+  }
+
+  /// Combined pose and axis control output, before thruster mapping
+  AxisValueVector computeControl( ControlInputs const & inputs )
+  {
+    /// the PIDs run at the measurement rate, and hold their output in between
+    if( inputs.measurement_stamp_ != pid_stamp_ )
+      {
+	setSetpoint( inputs.pose_error_ );
+	setScheduleVariables( inputs.schedule_variables_ );
+	pose_control_ = updateAllPID( inputs.measurement_stamp_, inputs.measurement_arrival_ );
+	pid_stamp_ = inputs.measurement_stamp_;
+      }
 
-    AxisValueVector pose_control = updateAllPID();
+    AxisValueVector pose_control = pose_control_;
 
     /// apply scaling
-    pose_control.block(0,0,3,1) *= config_->pose_scale_linear;
-    pose_control.block(3,0,3,1) *= config_->pose_scale_angular;
+    pose_control.block(0,0,3,1) *= inputs.pose_scale_linear_;
+    pose_control.block(3,0,3,1) *= inputs.pose_scale_angular_;
+
+    return pose_control + inputs.axis_command_;
+  }
+
+  void startControlThread()
+  {
+    double const rate = uscauv::param::load<double>( nh_rel_, "control_rate", getLoopRate() );
+    int const priority = uscauv::param::load<int>( nh_rel_, "control_priority", 0 );
+    int const cpu = uscauv::param::load<int>( nh_rel_, "control_cpu", -1 );
+    double const bin_width = uscauv::param::load<double>( nh_rel_, "loop_timing_bin_width", 0.0005 );
+    double const report_period = uscauv::param::load<double>( nh_rel_, "loop_timing_period", 1.0 );
+    
+    if( !control_thread_.start( std::bind( &ControlServerNode::controlThreadCycle, this ), rate, priority, cpu,
+				bin_width, report_period ) )
+      {
+	ROS_WARN( "Running the control loop on the ROS thread instead." );
+	use_control_thread_ = false;
+      }
+  }
 
-    AxisValueVector all_control = pose_control + axis_command_value_;
+  void controlThreadCycle()
+  {
+    /// keeps the last inputs if nothing new has arrived
+    control_inputs_buffer_.read( thread_inputs_ );
+    runControlCycle( thread_inputs_ );
+  }
+
+  void publishLoopTiming()
+  {
+    if( control_thread_.getStatisticsVersion() == loop_timing_version_ )
+      return;
+    loop_timing_version_ = control_thread_.getStatisticsVersion();
     
+    uscauv::ControlThread::TimingStatistics statistics;
+    if( !control_thread_.getStatistics( statistics ) )
+      return;
+
+    _LoopTimingMsg msg;
+    control_thread_.toMsg( statistics, msg );
+    loop_timing_pub_.publish( msg );
+  }
+
+  static geometry_msgs::Twist axisToTwistMsg( AxisValueVector const & all_control )
+  {
     geometry_msgs::Twist control_out;
     control_out.linear.x = all_control(0);
     control_out.linear.y = all_control(1);
@@ -141,13 +375,15 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
     control_out.angular.y = all_control(4);
     control_out.angular.z = all_control(5);
     
-    axis_pub_.publish( control_out );
+    return control_out;
   }
   
  private:
   
   void axisCommandCallback(_MaskedTwistMsg::ConstPtr const & msg)
   {
+    ros::Time const received = ros::Time::now();
+    
     /// kinda hack-y, msg.mask's numeric variables are floats, when they should be bools
     AxisValueVector input_value, input_mask_float;
     AxisMaskVector input_mask_bool;
@@ -167,28 +403,42 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
 	    axis_command_value_( idx ) = input_value( idx );
 	  }
       }
-    
+    axis_command_changed_ = true;
+
+    if( uscauv::isTraced( msg->trace ) )
+      {
+	control_inputs_.command_trace_.fromMsg( msg->trace );
+	control_inputs_.command_received_ = received;
+      }
   }
 
-  void updatePoseCommand()
+  /** 
+   * Look up the error between the desired and measured pose
+   * 
+   * @param measurement_time Time of the measurement to use, or 0 for the latest
+   * 
+   * @return False if either transform isn't available
+   */
+  bool updatePoseCommand( ros::Time const & measurement_time )
   {
     tf::StampedTransform world_to_desired_tf, world_to_measurement_tf;
     
-    if( tf_listener_.canTransform( "/world", MEASUREMENT_FRAME_NAME, ros::Time(0) ))
+    if( tf_listener_.canTransform( "/world", MEASUREMENT_FRAME_NAME, measurement_time ))
       {
 	try
 	  {
-	    tf_listener_.lookupTransform( "/world", MEASUREMENT_FRAME_NAME, ros::Time(0), world_to_measurement_tf);
+	    tf_listener_.lookupTransform( "/world", MEASUREMENT_FRAME_NAME, measurement_time, world_to_measurement_tf);
 
 	  }
 	catch(tf::TransformException & ex)
 	  {
 	    ROS_ERROR( "%s", ex.what() );
-	    return;
+	    return false;
 	  }
       }
-    else return;
+    else return false;
     
+    /// the desired pose is whatever was set last
     if( tf_listener_.canTransform( "/world", DESIRED_FRAME_NAME, ros::Time(0) ))
       {
 	try
@@ -199,10 +449,10 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
 	catch(tf::TransformException & ex)
 	  {
 	    ROS_ERROR( "%s", ex.what() );
-	    return;
+	    return false;
 	  }
       }
-    else return;
+    else return false;
 
     tf::Transform error_tf = world_to_measurement_tf.inverse() * world_to_desired_tf;
     double roll, pitch, yaw;
@@ -217,12 +467,39 @@ class ControlServerNode: public BaseNode, public uscauv::PID6D, MultiReconfigure
     /* error_pose_value.block(0,0,3,1) *= config_->pose_scale_linear; */
     /* error_pose_value.block(3,0,3,1) *= config_->pose_scale_angular; */
     
-    setSetpoint<PID6D::Axes::SURGE>( error_pose_value(0) );
-    setSetpoint<PID6D::Axes::SWAY> ( error_pose_value(1) );
-    setSetpoint<PID6D::Axes::HEAVE>( error_pose_value(2) );
-    setSetpoint<PID6D::Axes::ROLL> ( error_pose_value(3) );
-    setSetpoint<PID6D::Axes::PITCH>( error_pose_value(4) );
-    setSetpoint<PID6D::Axes::YAW>  ( error_pose_value(5) );
+    control_inputs_.pose_error_ = error_pose_value;
+
+    if( hasSchedule() )
+      updateScheduleVariables( world_to_measurement_tf );
+    
+    return true;
+  }
+
+  /// Depth is the measured z, same as on the depth topic. Forward speed is differenced from consecutive measurements.
+  void updateScheduleVariables( tf::StampedTransform const & world_to_measurement_tf )
+  {
+    ScheduleVector & variables = control_inputs_.schedule_variables_;
+    variables( uscauv::ReconfigurablePIDSettings::SCHEDULE_DEPTH ) = world_to_measurement_tf.getOrigin().z();
+
+    double const dt = has_last_measurement_tf_ ? 
+      ( world_to_measurement_tf.stamp_ - last_measurement_tf_.stamp_ ).toSec() : 0;
+    
+    /// in the stale case the same measurement can be looked up more than once
+    if( has_last_measurement_tf_ && dt <= 0 )
+      return;
+    
+    if( has_last_measurement_tf_ )
+      {
+	tf::Vector3 const displacement = world_to_measurement_tf.getOrigin() - last_measurement_tf_.getOrigin();
+	double const speed = world_to_measurement_tf.getBasis().transpose()[0].dot( displacement ) / dt;
+
+	/// differenced positions are noisy, and noisy gains would show up in the output
+	double & filtered_speed = variables( uscauv::ReconfigurablePIDSettings::SCHEDULE_SPEED );
+	filtered_speed += dt / ( speed_filter_ + dt ) * ( speed - filtered_speed );
+      }
+    
+    last_measurement_tf_ = world_to_measurement_tf;
+    has_last_measurement_tf_ = true;
   }
   
 };
@@ -0,0 +1,307 @@
+/***************************************************************************
+ *  include/auv_controls/control_thread.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_AUVCONTROLS_CONTROLTHREAD
+#define USCAUV_AUVCONTROLS_CONTROLTHREAD
+
+// ROS
+#include <ros/ros.h>
+
+// uscauv
+#include <uscauv_common/double_buffer.h>
+
+#include <auv_controls/LoopTiming.h>
+
+#include <pthread.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <vector>
+
+namespace uscauv
+{
+
+  /**
+   * Calls a function at a fixed rate from its own thread. Each cycle sleeps until an absolute deadline
+   * on the monotonic clock, so time spent in the function doesn't push the next cycle back. If a cycle
+   * runs past the next deadline, the missed deadlines are skipped rather than run back to back.
+   *
+   * The thread can be given a real-time priority (SCHED_FIFO) and pinned to a CPU. Period, jitter and
+   * overrun statistics are kept by the thread and handed out through a DoubleBuffer.
+   */
+  class ControlThread
+  {
+  public:
+    static unsigned int const NUM_BINS = 64;
+
+    struct Histogram
+    {
+      unsigned int count_;
+      double sum_, max_;
+      unsigned int bins_[ NUM_BINS ];
+    };
+    
+    struct TimingStatistics
+    {
+      Histogram period_, jitter_, overrun_;
+      unsigned int skipped_deadlines_;
+    };
+
+  private:
+    std::function<void()> cycle_;
+    
+    std::thread thread_;
+    std::atomic<bool> running_;
+    
+    long period_ns_;
+    int priority_, cpu_;
+    double bin_width_, report_period_;
+
+    /// only touched by the thread
+    TimingStatistics statistics_;
+    DoubleBuffer<TimingStatistics> statistics_buffer_;
+    
+  public:
+  ControlThread(): running_( false ), period_ns_( 0 ), priority_( 0 ), cpu_( -1 ), bin_width_( 0 ), report_period_( 0 ) {}
+    
+    ~ControlThread()
+    {
+      stop();
+    }
+
+    /** 
+     * @param cycle Called once per period from the thread
+     * @param rate Frequency in Hz
+     * @param priority SCHED_FIFO priority, or 0 to keep the default scheduler
+     * @param cpu CPU to pin the thread to, or -1 for any
+     * @param bin_width Width of each histogram bin, in seconds
+     * @param report_period How often to hand out statistics, in seconds
+     * 
+     * @return False if the rate or bin width isn't positive, in which case no thread is started
+     */
+    bool start( std::function<void()> const & cycle, double const & rate, int const & priority, int const & cpu,
+		double const & bin_width, double const & report_period )
+    {
+      if( rate <= 0 || bin_width <= 0 )
+	{
+	  ROS_ERROR( "Control thread rate (%f Hz) and bin width (%f s) must be positive.", rate, bin_width );
+	  return false;
+	}
+      
+      stop();
+      
+      cycle_ = cycle;
+      period_ns_ = 1e9 / rate;
+      priority_ = priority;
+      cpu_ = cpu;
+      bin_width_ = bin_width;
+      report_period_ = report_period;
+      
+      running_ = true;
+      thread_ = std::thread( &ControlThread::loop, this );
+      
+      ROS_INFO( "Started control thread at %.2f Hz (priority %d, cpu %d).", rate, priority, cpu );
+      return true;
+    }
+
+    void stop()
+    {
+      running_ = false;
+      if( thread_.joinable() )
+	thread_.join();
+    }
+
+    bool running() const
+    {
+      return running_;
+    }
+    
+    /// Latest statistics, see DoubleBuffer::read()
+    bool getStatistics( TimingStatistics & statistics ) const
+    {
+      return statistics_buffer_.read( statistics );
+    }
+
+    unsigned int getStatisticsVersion() const
+    {
+      return statistics_buffer_.version();
+    }
+
+    void toMsg( TimingStatistics const & statistics, auv_controls::LoopTiming & msg ) const
+    {
+      msg.bin_width = bin_width_;
+      msg.cycles = statistics.period_.count_;
+      
+      histogramToMsg( statistics.period_, msg.period_mean, msg.period_max, msg.period_histogram );
+      histogramToMsg( statistics.jitter_, msg.jitter_mean, msg.jitter_max, msg.jitter_histogram );
+      histogramToMsg( statistics.overrun_, msg.overrun_mean, msg.overrun_max, msg.overrun_histogram );
+      msg.overruns = statistics.overrun_.count_;
+      msg.skipped_deadlines = statistics.skipped_deadlines_;
+    }
+
+  private:
+    void loop()
+    {
+      setScheduling();
+      resetStatistics();
+      
+      timespec deadline, wake, last_wake, done, last_report;
+      clock_gettime( CLOCK_MONOTONIC, &deadline );
+      last_wake = last_report = deadline;
+      
+      while( running_ && ros::ok() )
+	{
+	  addNanoseconds( deadline, period_ns_ );
+	  
+	  /// absolute, so it doesn't matter how long the last cycle took. Restart if a signal interrupts it.
+	  while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL ) == EINTR );
+	  
+	  clock_gettime( CLOCK_MONOTONIC, &wake );
+	  
+	  cycle_();
+
+	  clock_gettime( CLOCK_MONOTONIC, &done );
+
+	  // ################################################################
+	  // Statistics
+	  // ################################################################
+	  addSample( statistics_.period_, seconds( wake, last_wake ) );
+	  addSample( statistics_.jitter_, seconds( wake, deadline ) );
+	  last_wake = wake;
+
+	  timespec next_deadline = deadline;
+	  addNanoseconds( next_deadline, period_ns_ );
+	  if( seconds( done, next_deadline ) > 0 )
+	    {
+	      addSample( statistics_.overrun_, seconds( done, next_deadline ) );
+
+	      /// keep the phase, but don't try to make up for the cycles that were missed
+	      while( seconds( done, next_deadline ) > 0 )
+		{
+		  deadline = next_deadline;
+		  addNanoseconds( next_deadline, period_ns_ );
+		  ++statistics_.skipped_deadlines_;
+		}
+	    }
+	  
+	  if( seconds( done, last_report ) >= report_period_ )
+	    {
+	      statistics_buffer_.write( statistics_ );
+	      resetStatistics();
+	      last_report = done;
+	    }
+	}
+
+      running_ = false;
+    }
+    
+    void setScheduling()
+    {
+      if( priority_ > 0 )
+	{
+	  sched_param param;
+	  param.sched_priority = priority_;
+	  int const error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+	  if( error )
+	    ROS_WARN( "Failed to set control thread priority to %d [ %s ]. Running with default scheduling.",
+		      priority_, strerror( error ) );
+	}
+
+      if( cpu_ >= 0 )
+	{
+	  cpu_set_t cpus;
+	  CPU_ZERO( &cpus );
+	  CPU_SET( cpu_, &cpus );
+	  int const error = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+	  if( error )
+	    ROS_WARN( "Failed to pin control thread to cpu %d [ %s ].", cpu_, strerror( error ) );
+	}
+    }
+
+    void resetStatistics()
+    {
+      /// value-initialized, so all zeros
+      statistics_ = TimingStatistics();
+    }
+
+    /// The last bin also counts everything past the end of the histogram
+    void addSample( Histogram & histogram, double const & value ) const
+    {
+      double const clamped = std::max( value, 0.0 );
+      unsigned int const bin = std::min<double>( clamped / bin_width_, NUM_BINS - 1 );
+      
+      ++histogram.bins_[ bin ];
+      ++histogram.count_;
+      histogram.sum_ += value;
+      histogram.max_ = std::max( histogram.max_, value );
+    }
+
+    static void histogramToMsg( Histogram const & histogram, double & mean, double & max, std::vector<uint32_t> & bins )
+    {
+      mean = histogram.count_ ? histogram.sum_ / histogram.count_ : 0;
+      max = histogram.max_;
+      bins.assign( histogram.bins_, histogram.bins_ + NUM_BINS );
+    }
+
+    static void addNanoseconds( timespec & time, long const & ns )
+    {
+      time.tv_nsec += ns;
+      while( time.tv_nsec >= 1000000000L )
+	{
+	  time.tv_nsec -= 1000000000L;
+	  ++time.tv_sec;
+	}
+    }
+
+    /// a - b
+    static double seconds( timespec const & a, timespec const & b )
+    {
+      return ( a.tv_sec - b.tv_sec ) + 1e-9 * ( a.tv_nsec - b.tv_nsec );
+    }
+    
+  };
+
+} // uscauv
+
+#endif // USCAUV_AUVCONTROLS_CONTROLTHREAD
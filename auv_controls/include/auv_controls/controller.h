@@ -36,8 +36,11 @@
 #include <ros/ros.h>
 
 #include <array>
+#include <chrono>
 
 #include <auv_controls/pid.h>
+#include <auv_controls/PIDFeedback.h>
+#include <uscauv_common/param_loader.h>
 #include <Eigen/Dense>
 
 namespace uscauv
@@ -100,6 +103,17 @@ namespace uscauv
       return controllers_.at(__Idx).update();
     }
 
+    /** 
+     * Get the controller's current error term, for a measurement taken at stamp
+     * 
+     * @return Error term
+     */
+    template <unsigned int __Idx>
+      typename std::enable_if<(__Idx < __Dim), double>::type update(ros::Time const & stamp)
+    {
+      return controllers_.at(__Idx).update(stamp);
+    }
+
     /* /\**  */
     /*  * Update all individual controllers */
     /*  *  */
@@ -127,34 +141,247 @@ namespace uscauv
     
   };
   
-  class PID6D: public ControllerND< uscauv::PID1D, 6 >
-    {
-    public:
+  /**
+   * Six PID loops (x, y, z, roll, pitch, yaw) computed together as vector operations, with a single
+   * timestamp for all axes. Each axis still has its own reconfigurable gains. dt comes from steady_clock,
+   * so adjusting the system clock can't corrupt the I and D terms. ROS time is only used to stamp feedback.
+   *
+   * The I term is clamped to +/- i_max (anti-windup) and the D term is low-pass filtered with time
+   * constant d_filter. The first update, and the first one after a gap of more than ~pid/max_dt,
+   * has no I or D contribution, so dt is never zero or meaningless. The state of all axes is
+   * published as one message every ~pid/feedback_decimation updates.
+   *
+   * An axis with a gain schedule (see ReconfigurablePIDSettings) has its gains scaled according to the
+   * latest value passed to setScheduleVariables().
+   */
+  class PID6D
+  {
+  public:
+    typedef Eigen::Matrix<double, 6, 1> AxisVector;
+    typedef Eigen::Matrix<double, ReconfigurablePIDSettings::NUM_SCHEDULE_VARIABLES, 1> ScheduleVector;
+    
+    enum Axes
+    { SURGE = 0, SWAY = 1, HEAVE = 2,
+      ROLL = 3,  PITCH = 4, YAW = 5 };
 
-      enum Axes
-      { SURGE = 0, SWAY = 1, HEAVE = 2,
-	YAW = 3,   PITCH = 4,  ROLL = 5 };
+  private:
+    typedef auv_controls::PIDFeedback _PIDFeedbackMsg;
+    typedef ReconfigurablePIDSettings::PIDGains _PIDGains;
+
+  public:
+    typedef std::chrono::steady_clock _Clock;
 
-      void loadController()
+  private:
+    
+    std::array<ReconfigurablePIDSettings, 6> settings_;
+    std::array<unsigned int, 6> gains_version_;
+    
+    AxisVector p_gain_, i_gain_, d_gain_, i_max_, d_filter_, mod_val_;
+    Eigen::Matrix<bool, 6, 1> use_mod_;
+
+    /// gains after scheduling, used by the last update
+    AxisVector p_scheduled_, i_scheduled_, d_scheduled_;
+    ScheduleVector schedule_variables_;
+    bool has_schedule_;
+
+    AxisVector setpoint_, observed_, integral_, last_error_, derivative_, output_;
+    ros::Time last_update_time_;
+    _Clock::time_point last_update_clock_;
+    bool has_last_update_;
+    double max_dt_;
+
+    /// ROS
+    ros::NodeHandle nh_rel_;
+    ros::Publisher feedback_pub_;
+    unsigned int feedback_decimation_, updates_since_feedback_;
+    
+  public:
+  PID6D(): has_schedule_( false ), has_last_update_( false ), max_dt_( 1.0 ), nh_rel_( "~" ), feedback_decimation_( 0 ), updates_since_feedback_( 0 )
       {
-	init("linear/x", "linear/y", "linear/z",
-	     "angular/yaw", "angular/pitch", "angular/roll");
+	gains_version_.fill( 0 );
+	p_gain_ = i_gain_ = d_gain_ = i_max_ = d_filter_ = mod_val_ = AxisVector::Zero();
+	use_mod_.setConstant( false );
+	p_scheduled_ = i_scheduled_ = d_scheduled_ = AxisVector::Zero();
+	schedule_variables_ = ScheduleVector::Zero();
+	setpoint_ = observed_ = integral_ = last_error_ = derivative_ = output_ = AxisVector::Zero();
       }
+    
+    void loadController( std::string const & ns = "pid" )
+    {
+      static char const * const axis_names[6] = 
+	{ "linear/x", "linear/y", "linear/z", "angular/roll", "angular/pitch", "angular/yaw" };
 
-      Eigen::Matrix<double, 6, 1> updateAllPID()
+      /// Reconfigure servers resolve relative to ~/ns/axis, same as they always have
+      for( unsigned int axis = 0; axis < 6; ++axis )
 	{
-	  Eigen::Matrix<double, 6, 1> output;
-
-	  output(0) = update<SURGE>();
-	  output(1) = update<SWAY>();
-	  output(2) = update<HEAVE>();
-	  output(3) = update<ROLL>();
-	  output(4) = update<PITCH>();
-	  output(5) = update<YAW>();
+	  settings_[ axis ].init( ns + "/" + axis_names[ axis ] );
+	  has_schedule_ |= settings_[ axis ].hasSchedule();
+	}
+
+      ros::NodeHandle nh_pid( nh_rel_, ns );
+      feedback_decimation_ = uscauv::param::load<int>( nh_pid, "feedback_decimation", 10 );
+      max_dt_ = uscauv::param::load<double>( nh_pid, "max_dt", 1.0 );
+      
+      feedback_pub_ = nh_pid.advertise<_PIDFeedbackMsg>( "feedback", 1 );
+    }
+
+    void setSetpoint( AxisVector const & setpoint )
+    {
+      setpoint_ = setpoint;
+    }
+
+    void setObserved( AxisVector const & observed )
+    {
+      observed_ = observed;
+    }
+
+    /// Values that the gains are scheduled on, indexed by ReconfigurablePIDSettings::ScheduleVariable
+    void setScheduleVariables( ScheduleVector const & variables )
+    {
+      schedule_variables_ = variables;
+    }
+
+    bool hasSchedule() const
+    {
+      return has_schedule_;
+    }
+    
+    /** 
+     * Can be called from a different thread than the one running ROS callbacks.
+     * 
+     * @param stamp Time that the observed values were measured at, for the feedback message
+     * @param measured_at When the observed values were measured on the monotonic clock, which dt is taken from
+     * 
+     * @return Controller output. Unchanged if stamp is the same as last time.
+     */
+    AxisVector updateAllPID( ros::Time const & stamp, _Clock::time_point const & measured_at )
+    {
+      if( has_last_update_ && stamp == last_update_time_ )
+	return output_;
+      
+      updateGains();
+      scheduleGains();
+      
+      AxisVector error = setpoint_ - observed_;
+      for( unsigned int axis = 0; axis < 6; ++axis )
+	{
+	  if( use_mod_( axis ) )
+	    error( axis ) = -uscauv::ring_difference( setpoint_( axis ), observed_( axis ), mod_val_( axis ) );
+	}
+
+      double const dt = std::chrono::duration<double>( measured_at - last_update_clock_ ).count();
+      
+      if( has_last_update_ && dt > 0 && dt <= max_dt_ )
+	{
+	  integral_ += error * dt;
 	  
-	  return output;
+	  /// anti-windup, an I term past i_max only takes longer to unwind
+	  for( unsigned int axis = 0; axis < 6; ++axis )
+	    {
+	      if( i_max_( axis ) > 0 && i_scheduled_( axis ) != 0 )
+		{
+		  double const limit = i_max_( axis ) / fabs( i_scheduled_( axis ) );
+		  integral_( axis ) = std::min( std::max( integral_( axis ), -limit ), limit );
+		}
+	    }
+
+	  /// first order low-pass, alpha = dt / ( tau + dt )
+	  AxisVector const raw_derivative = ( error - last_error_ ) / dt;
+	  AxisVector const alpha = ( ( d_filter_.array() + dt ).inverse() * dt ).matrix();
+	  derivative_ += alpha.cwiseProduct( raw_derivative - derivative_ );
+	}
+      else
+	{
+	  /// first update, or the clock jumped
+	  derivative_.setZero();
+	}
+
+      last_error_ = error;
+      last_update_time_ = stamp;
+      last_update_clock_ = measured_at;
+      has_last_update_ = true;
+      
+      output_ = p_scheduled_.cwiseProduct( error ) + i_scheduled_.cwiseProduct( integral_ ) + d_scheduled_.cwiseProduct( derivative_ );
+
+      if( feedback_decimation_ && ++updates_since_feedback_ >= feedback_decimation_ )
+	{
+	  publishFeedback( error );
+	  updates_since_feedback_ = 0;
+	}
+
+      return output_;
+    }
+
+  private:
+    /// Pick up reconfigured gains. Reconfiguring an axis resets its integral term.
+    void updateGains()
+    {
+      for( unsigned int axis = 0; axis < 6; ++axis )
+	{
+	  unsigned int const version = settings_[ axis ].getGainsVersion();
+	  if( version == gains_version_[ axis ] )
+	    continue;
+
+	  _PIDGains gains;
+	  if( !settings_[ axis ].getGains( gains ) )
+	    continue;
+	  gains_version_[ axis ] = version;
+
+	  p_gain_( axis ) = gains.p_gain_;
+	  i_gain_( axis ) = gains.i_gain_;
+	  d_gain_( axis ) = gains.d_gain_;
+	  i_max_( axis ) = gains.i_max_;
+	  d_filter_( axis ) = gains.d_filter_;
+	  use_mod_( axis ) = gains.use_mod_;
+	  mod_val_( axis ) = gains.mod_val_;
+
+	  ROS_INFO( "Resetting integral term [ %s ]...", settings_[ axis ].name_.c_str() );
+	  integral_( axis ) = 0;
+	}
+    }
+
+    /// Scale the reconfigured gains of the axes that have a schedule
+    void scheduleGains()
+    {
+      p_scheduled_ = p_gain_;
+      i_scheduled_ = i_gain_;
+      d_scheduled_ = d_gain_;
+      
+      if( !has_schedule_ )
+	return;
+      
+      for( unsigned int axis = 0; axis < 6; ++axis )
+	{
+	  ReconfigurablePIDSettings const & settings = settings_[ axis ];
+	  if( !settings.hasSchedule() )
+	    continue;
+
+	  ReconfigurablePIDSettings::GainScale const scale = 
+	    settings.getGainScale( schedule_variables_( settings.getScheduleVariable() ) );
+	  p_scheduled_( axis ) *= scale.p_;
+	  i_scheduled_( axis ) *= scale.i_;
+	  d_scheduled_( axis ) *= scale.d_;
 	}
+    }
+
+    void publishFeedback( AxisVector const & error )
+    {
+      _PIDFeedbackMsg msg;
+      msg.header.stamp = last_update_time_;
       
-    };
+      for( unsigned int axis = 0; axis < 6; ++axis )
+	{
+	  msg.setpoint[ axis ] = setpoint_( axis );
+	  msg.observed[ axis ] = observed_( axis );
+	  msg.error[ axis ] = error( axis );
+	  msg.integral[ axis ] = integral_( axis );
+	  msg.derivative[ axis ] = derivative_( axis );
+	  msg.output[ axis ] = output_( axis );
+	}
+      
+      feedback_pub_.publish( msg );
+    }
+      
+  };
 
 } // uscauv
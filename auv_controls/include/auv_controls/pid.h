@@ -43,9 +43,9 @@
 #include <dynamic_reconfigure/server.h>
 #include <auv_controls/PIDConfig.h>
 
-#include <auv_controls/FeedbackLoop.h>
-
 #include <uscauv_common/simple_math.h>
+#include <uscauv_common/double_buffer.h>
+#include <uscauv_common/lookup_table.h>
 
 namespace uscauv
 {
@@ -56,11 +56,41 @@ class ReconfigurablePIDSettings
   typedef auv_controls::PIDConfig _PIDConfig;
   typedef dynamic_reconfigure::Server<_PIDConfig> _PIDReconfigureServer;
 
+ public:
+  /// The parts of the config that the loop uses. Plain data, so that it can be handed to another thread.
+  struct PIDGains
+  {
+    double p_gain_, i_gain_, d_gain_;
+    bool use_mod_;
+    double mod_val_;
+    double i_max_, d_filter_;
+  };
+
+  /// Quantities that the gains can be scheduled on
+  enum ScheduleVariable
+  { SCHEDULE_DEPTH = 0, SCHEDULE_SPEED = 1,
+    NUM_SCHEDULE_VARIABLES = 2 };
+  
+  /// Factors that the reconfigured gains are multiplied by at one value of the scheduling variable
+  struct GainScale
+  {
+    double p_, i_, d_;
+  };
+  
  public:
   _PIDConfig config_;
   std::string name_;
 
  private:
+  /// number of evenly spaced keys that gain schedules are resampled at
+  static unsigned int const SCHEDULE_SAMPLES = 256;
+  
+  DoubleBuffer<PIDGains> gains_buffer_;
+
+  /// Only written by init(), so lookups are safe from any thread afterwards
+  bool has_schedule_;
+  ScheduleVariable schedule_variable_;
+  UniformLookupTable<double, double> p_schedule_, i_schedule_, d_schedule_;
   
   ros::NodeHandle nh_rel_, nh_pid_;
   std::shared_ptr<_PIDReconfigureServer> reconfigure_server_;
@@ -70,7 +100,9 @@ class ReconfigurablePIDSettings
  public:
   /// TODO: Modify so that ROS doesn't need to be running when the class is constructed
  ReconfigurablePIDSettings():
-  nh_rel_( "~" )
+  has_schedule_( false ),
+    schedule_variable_( SCHEDULE_DEPTH ),
+    nh_rel_( "~" )
   {
   }
 
@@ -80,6 +112,9 @@ class ReconfigurablePIDSettings
 
     /// Reconfigure server will resolve namespaces relative to ~/ns/name
     nh_pid_ = ros::NodeHandle( nh_rel_, name_ );
+
+    if( loadSchedule() )
+      ROS_WARN( "Failed to load gain schedule for [ %s ]. Gains will not be scheduled.", name_.c_str() );
     
     reconfigure_server_ = std::make_shared<_PIDReconfigureServer>( nh_pid_ );
 
@@ -97,6 +132,16 @@ class ReconfigurablePIDSettings
   {
     config_ = config;
 
+    PIDGains gains;
+    gains.p_gain_ = config.p_gain;
+    gains.i_gain_ = config.i_gain;
+    gains.d_gain_ = config.d_gain;
+    gains.use_mod_ = config.use_mod;
+    gains.mod_val_ = config.mod_val;
+    gains.i_max_ = config.i_max;
+    gains.d_filter_ = config.d_filter;
+    gains_buffer_.write( gains );
+
     if ( settings_changed_callback_ )
       {
 	try
@@ -117,123 +162,115 @@ class ReconfigurablePIDSettings
     settings_changed_callback_ = callback;
     return;
   }
-  
-};
 
-class PID1D
-{
- private:
-  double setpoint_, integral_term_, observed_value_, last_error_;
-
-  ros::Time last_update_time_;
-  std::string name_;
-
-  ReconfigurablePIDSettings settings_;
-
- private:
-  typedef auv_controls::FeedbackLoop _FeedbackLoopMsg;
-  
-  /// ROS interfaces
-  ros::NodeHandle nh_rel_, nh_pid_;
-
-  ros::Publisher feedback_pub_;
-  
- public:
-
- PID1D():
-  setpoint_( 0.0f ),
-  integral_term_( 0.0f ),
-  observed_value_( 0.0f ),
-  last_error_( 0.0f ),
-  nh_rel_("~")
-    {
-      
-    }
- 
-  void init(std::string const & name, std::string const & ns = "pid")
+  /// Latest gains. Unlike config_, safe to call from a thread other than the one running ROS callbacks.
+  bool getGains( PIDGains & gains ) const
   {
-    name_ = ns + "/" + name;
-    
-    /// nh_pid will resolve namespaces relative to ~/ns/name
-    nh_pid_ = ros::NodeHandle( nh_rel_, name_ );
-    
-    settings_.init( name_ );
-
-    std::function<void()> reconfigure_cb = std::bind(&PID1D::reconfigureCallback, this);
-
-    settings_.registerCallback( reconfigure_cb );
-    
-    feedback_pub_ = nh_pid_.advertise<_FeedbackLoopMsg>( "feedback", 1 );
-    
-    ROS_INFO("Created PID publisher [ %s ].", (name_ + "/feedback").c_str());
+    return gains_buffer_.read( gains );
+  }
 
-    last_update_time_ = ros::Time::now();
+  /// Changes every time the gains are reconfigured
+  unsigned int getGainsVersion() const
+  {
+    return gains_buffer_.version();
+  }
 
-    return;
+  bool hasSchedule() const
+  {
+    return has_schedule_;
   }
 
-  void setSetpoint(double const & setpoint)
+  ScheduleVariable getScheduleVariable() const
   {
-    setpoint_ = setpoint;
-    return;
+    return schedule_variable_;
   }
-  
-  void setObserved(double const & observed)
+
+  /** 
+   * @param value Current value of the scheduling variable
+   * 
+   * @return Scale factors for the gains. 1 for gains that aren't scheduled.
+   */
+  GainScale getGainScale( double const & value ) const
   {
-    observed_value_ = observed;
-    return;
+    GainScale scale;
+    scale.p_ = p_schedule_.empty() ? 1.0 : p_schedule_.lookup( value );
+    scale.i_ = i_schedule_.empty() ? 1.0 : i_schedule_.lookup( value );
+    scale.d_ = d_schedule_.empty() ? 1.0 : d_schedule_.lookup( value );
+    return scale;
   }
-  
-  double update()
+
+ private:
+  /** 
+   * Load the optional gain schedule at ~/ns/name/schedule, e.g.
+   *
+   *   schedule: { variable: depth, key: [0.0, 0.5, 2.0], p_scale: [0.6, 0.8, 1.0], d_scale: [1.5, 1.2, 1.0] }
+   *
+   * Each table is interpolated with monotone cubics between the keys and resampled onto an even grid
+   * once, here, so that an update only pays for a multiply and a lerp. Gains without a table aren't scheduled.
+   * 
+   * @return 0 on success or if there is no schedule, -1 otherwise
+   */
+  int loadSchedule()
   {
-    auv_controls::PIDConfig const & config = settings_.config_;
-    
-    ros::Time now = ros::Time::now();
-    
-    double dt = (now - last_update_time_).toSec();
+    XmlRpc::XmlRpcValue xml_schedule;
+    if( !nh_pid_.getParam( "schedule", xml_schedule ) )
+      return 0;
 
-    /// error terms
-    double error;
-    if( config.use_mod )
-      error = -uscauv::ring_difference( setpoint_, observed_value_, config.mod_val );
-    else
-      error = setpoint_ - observed_value_;
-    double dedt = (error - last_error_) / dt;
-    integral_term_ += error * dt;
-    last_error_ = error;
+    /// hasMember() doesn't check the type on its own
+    if( xml_schedule.getType() != XmlRpc::XmlRpcValue::TypeStruct )
+      {
+	ROS_WARN( "Gain schedule for [ %s ] is not a struct.", name_.c_str() );
+	return -1;
+      }
+
+    std::string variable;
+    try
+      {
+	variable = uscauv::param::lookup<std::string>( xml_schedule, "variable" );
+      }
+    catch( XmlRpc::XmlRpcException const & ex )
+      {
+	ROS_WARN( "Caught exception [ %s ] loading gain schedule variable.", ex.getMessage().c_str() );
+	return -1;
+      }
     
-    double const & p = config.p_gain;
-    double const & i = config.i_gain;
-    double const & d = config.d_gain;
+    if( variable == "depth" )
+      schedule_variable_ = SCHEDULE_DEPTH;
+    else if( variable == "speed" )
+      schedule_variable_ = SCHEDULE_SPEED;
+    else
+      {
+	ROS_WARN( "Unknown gain schedule variable [ %s ]. Must be depth or speed.", variable.c_str() );
+	return -1;
+      }
 
-    double output = p*error + i*integral_term_ + d*dedt;
-        
-    last_update_time_ = now;
-      
-    publishLoop(setpoint_, observed_value_, output);
+    if( loadScheduleTable( xml_schedule, "p_scale", p_schedule_ ) ||
+	loadScheduleTable( xml_schedule, "i_scale", i_schedule_ ) ||
+	loadScheduleTable( xml_schedule, "d_scale", d_schedule_ ) )
+      return -1;
 
-    return output;
+    has_schedule_ = !p_schedule_.empty() || !i_schedule_.empty() || !d_schedule_.empty();
+    
+    if( has_schedule_ )
+      ROS_INFO( "Scheduling gains for [ %s ] on %s.", name_.c_str(), variable.c_str() );
+    
+    return 0;
   }
 
-  void reconfigureCallback()
+  int loadScheduleTable( XmlRpc::XmlRpcValue & xml_schedule, std::string const & value_name,
+			 UniformLookupTable<double, double> & grid )
   {
-    ROS_INFO("Resetting integral term...");
+    if( !xml_schedule.hasMember( value_name ) )
+      return 0;
+
+    LookupTable<double, double> table;
+    if( table.fromXmlRpc( xml_schedule, "key", value_name ) || !table.size() )
+      return -1;
 
-    integral_term_ = 0.0f;
+    grid.resample( table, SCHEDULE_SAMPLES, true );
+    return 0;
   }
   
- private:
-  void publishLoop(double const & x, double const & y, double const & e)
-    {
-      boost::shared_ptr<_FeedbackLoopMsg> msg( new _FeedbackLoopMsg );
-      
-      msg->x = x;
-      msg->y = y;
-      msg->e = e;
-      
-      feedback_pub_.publish(msg);
-    }
-   
 };
 
 } //uscauv
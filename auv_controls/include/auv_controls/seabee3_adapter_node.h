@@ -44,6 +44,7 @@
 
 // uscauv
 #include <uscauv_common/base_node.h>
+#include <uscauv_common/command_trace.h>
 
 #include <auv_msgs/MotorPowerArray.h>
 #include <seabee3_msgs/MotorVals.h>
@@ -66,12 +67,28 @@ static const std::map< std::string, int> thruster_map =
     {"thruster6", seabee3_common::movement::MotorControllerIDs::FWD_RIGHT_THRUSTER },
   };
 
+/// Motor controller ID of a thruster, or -1 if the name isn't mapped
+static inline int getMotorControllerId( std::string const & name )
+{
+  std::map<std::string, int>::const_iterator thruster_it = thruster_map.find( name );
+  if( thruster_it == thruster_map.end() )
+    {
+      ROS_WARN( "No motor controller ID for thruster [ %s ].", name.c_str() );
+      return -1;
+    }
+  return thruster_it->second;
+}
+
 class Seabee3AdapterNode: public BaseNode
 {
   /// ROS
   ros::NodeHandle nh_rel_;
   ros::Subscriber motor_levels_sub_;
-  ros::Publisher motor_vals_pub_;
+  ros::Publisher motor_vals_pub_, command_trace_pub_;
+
+  /// Motor controller ID for each position in the last motor array, or -1 if the name isn't mapped
+  std::vector<std::string> motor_names_;
+  std::vector<int> motor_ids_;
 
  public:
  Seabee3AdapterNode(): BaseNode("Seabee3Adapter"), nh_rel_("~")
@@ -84,6 +101,8 @@ class Seabee3AdapterNode: public BaseNode
   void spinFirst()
   {
     motor_vals_pub_ = nh_rel_.advertise<_MotorValsMsg>("motor_vals", 10);
+    /// the adapter is the last hop, so the traces are finished here
+    command_trace_pub_ = nh_rel_.advertise<uscauv::_CommandTraceMsg>("command_trace", 10);
     motor_levels_sub_ = nh_rel_.subscribe( "motor_levels", 10,
 					   &Seabee3AdapterNode::motorPowerArrayCallback, this );
     
@@ -98,30 +117,58 @@ class Seabee3AdapterNode: public BaseNode
   /// Map thrusters and publish result
   void motorPowerArrayCallback( _MotorPowerArrayMsg::ConstPtr const & msg )
   {
+    ros::Time const received = ros::Time::now();
     _MotorValsMsg motor_vals;
+
+    if( !layoutMatches( *msg ) )
+      updateLayout( *msg );
     
-    for( _MotorPowerMsg const & motor : msg->motors )
+    for( unsigned int idx = 0; idx < motor_ids_.size(); ++idx )
       {
-	int motor_id;
-
-	try
-	  {
-	    motor_id = thruster_map.at( motor.name );
-	  }
-	catch( std::exception const & ex )
-	  {
-	    ROS_WARN( "Caught exception [ %s ] looking up ID for thruster [ %s ].", ex.what(), motor.name.c_str() );
-	    continue;
-	  }
+	int const motor_id = motor_ids_[ idx ];
+	if( motor_id < 0 )
+	  continue;
 
 	motor_vals.mask[ motor_id ] = true;
-	motor_vals.motors[ motor_id ] = motor.power;
-		
+	motor_vals.motors[ motor_id ] = msg->motors[ idx ].power;
       }
 
     /* normalizeMotors( motor_vals ); */
 
+    motor_vals.trace = msg->trace;
+    uscauv::appendCommandHop( motor_vals.trace, uscauv::_CommandHopMsg::SEABEE3_ADAPTER, received );
+
     motor_vals_pub_.publish( motor_vals );
+
+    if( uscauv::isTraced( motor_vals.trace ) )
+      command_trace_pub_.publish( motor_vals.trace );
+  }
+
+  /// The mapper sends the same thrusters in the same order every time
+  bool layoutMatches( _MotorPowerArrayMsg const & msg ) const
+  {
+    if( msg.motors.size() != motor_names_.size() )
+      return false;
+
+    for( unsigned int idx = 0; idx < motor_names_.size(); ++idx )
+      {
+	if( msg.motors[ idx ].name != motor_names_[ idx ] )
+	  return false;
+      }
+    return true;
+  }
+
+  /// Resolve the names in the motor array to motor controller IDs
+  void updateLayout( _MotorPowerArrayMsg const & msg )
+  {
+    motor_names_.clear();
+    motor_ids_.clear();
+    
+    for( _MotorPowerMsg const & motor : msg.motors )
+      {
+	motor_names_.push_back( motor.name );
+	motor_ids_.push_back( getMotorControllerId( motor.name ) );
+      }
   }
 
  private:
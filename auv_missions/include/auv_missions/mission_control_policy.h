@@ -61,6 +61,7 @@
 #include <uscauv_common/multi_reconfigure.h>
 #include <uscauv_common/action_token.h>
 #include <uscauv_common/simple_math.h>
+#include <uscauv_common/command_trace.h>
 
 #include <auv_msgs/MaskedTwist.h>
 #include <auv_msgs/TrackedObjectArray.h>
@@ -459,6 +460,8 @@ namespace uscauv
 	
       while( !( term_crit && term_crit() ) && ros::ok() && token() )
 	{
+	  /// every command is traced, so that the collector can see where latency comes from
+	  uscauv::startCommandTrace( axis_command.trace );
 	  axis_command_pub_.publish( axis_command );
 	      
 	  loop_rate.sleep();
@@ -470,6 +473,7 @@ namespace uscauv
 	axis_command.twist.linear.x = 0;
 	axis_command.twist.linear.y = 0;
 	  
+	uscauv::startCommandTrace( axis_command.trace );
 	axis_command_pub_.publish( axis_command );
       }
       /* ROS_INFO("Cancelled"); */
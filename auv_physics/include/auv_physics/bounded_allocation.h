@@ -0,0 +1,305 @@
+/***************************************************************************
+ *  include/auv_physics/bounded_allocation.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_AUVPHYSICS_BOUNDEDALLOCATION
+#define USCAUV_AUVPHYSICS_BOUNDEDALLOCATION
+
+// ROS
+#include <ros/ros.h>
+
+/// math
+#include <Eigen/Dense>
+
+#include <vector>
+
+namespace uscauv
+{
+
+  /**
+   * Finds thruster values u that minimize || W ( B u - t ) ||^2 + r || u ||^2 subject to 
+   * lower <= u <= upper, where B maps thruster values to the six axes and W is a diagonal
+   * matrix of axis weights. When the thrusters saturate, the error goes to the axes with the
+   * smallest weights first. r picks the smallest solution when there are more thrusters than axes.
+   *
+   * Uses a primal active set method, warm started from the previous solution. Workspace is
+   * sized at compile time, so solving never allocates.
+   */
+  class BoundedAllocation
+  {
+  public:
+    static int const MAX_THRUSTERS = 16;
+    
+    typedef Eigen::Matrix<double, 6, 1> AxisVector;
+    typedef Eigen::Matrix<double, 6, Eigen::Dynamic, 0, 6, MAX_THRUSTERS> AxisMatrix;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_THRUSTERS, 1> ThrusterVector;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MAX_THRUSTERS, MAX_THRUSTERS> ThrusterMatrix;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 6, 0, MAX_THRUSTERS, 6> GradientMatrix;
+
+  private:
+    enum BoundState { FREE, AT_LOWER, AT_UPPER };
+    
+    /// B^T W^2 B + r I
+    ThrusterMatrix hessian_;
+    /// B^T W^2, so that the gradient at u = 0 is -gradient_ * t
+    GradientMatrix gradient_;
+    ThrusterVector lower_, upper_;
+    
+    ThrusterVector solution_;
+    std::vector<BoundState> state_;
+    std::vector<int> free_;
+    
+    /// workspace
+    ThrusterMatrix free_hessian_;
+    ThrusterVector linear_, free_rhs_, free_solution_;
+    Eigen::LDLT<ThrusterMatrix> ldlt_;
+
+    int saturated_;
+    int iterations_;
+    
+  public:
+  BoundedAllocation(): saturated_( 0 ), iterations_( 0 ) {}
+
+    /** 
+     * Set up the problem. Only needs to be called when the thrusters or the weights change.
+     * 
+     * @param thruster_to_axis B, six rows and a column per thruster
+     * @param axis_weights Diagonal of W
+     * @param regularization r
+     * @param lower Lowest value of each thruster
+     * @param upper Highest value of each thruster
+     */
+    template<class __AxisMatrix, class __ThrusterVector>
+    void setProblem( __AxisMatrix const & thruster_to_axis, AxisVector const & axis_weights,
+		     double const & regularization, __ThrusterVector const & lower, __ThrusterVector const & upper )
+    {
+      int const size = thruster_to_axis.cols();
+      ROS_ASSERT( size <= MAX_THRUSTERS && lower.rows() == size && upper.rows() == size );
+
+      gradient_ = thruster_to_axis.transpose() * axis_weights.array().square().matrix().asDiagonal();
+      hessian_ = gradient_ * thruster_to_axis;
+      hessian_.diagonal().array() += regularization;
+      
+      lower_ = lower;
+      upper_ = upper;
+      /// an empty range means the thruster is stuck at one value
+      upper_ = upper_.cwiseMax( lower_ );
+
+      solution_ = ThrusterVector::Zero( size ).cwiseMax( lower_ ).cwiseMin( upper_ );
+      state_.resize( size );
+      for( int idx = 0; idx < size; ++idx )
+	state_[ idx ] = pinned( idx ) ? AT_LOWER : FREE;
+      free_.reserve( size );
+    }
+
+    /**
+     * Replace one thruster's column and limits, keeping the rest of the problem and the warm start.
+     * Only the thruster's row and column of the hessian change, so this is linear in the number of thrusters.
+     *
+     * @param idx Index of the thruster
+     * @param thruster_to_axis B, with the thruster's new column
+     * @param axis_weights Diagonal of W, same as passed to setProblem()
+     * @param regularization r, same as passed to setProblem()
+     * @param lower Lowest value of the thruster
+     * @param upper Highest value of the thruster
+     */
+    template<class __AxisMatrix>
+    void updateThruster( int const & idx, __AxisMatrix const & thruster_to_axis, AxisVector const & axis_weights,
+			 double const & regularization, double const & lower, double const & upper )
+    {
+      ROS_ASSERT( idx >= 0 && idx < solution_.rows() && thruster_to_axis.cols() == solution_.rows() );
+
+      gradient_.row( idx ) = thruster_to_axis.col( idx ).transpose() * axis_weights.array().square().matrix().asDiagonal();
+      hessian_.row( idx ) = gradient_.row( idx ) * thruster_to_axis;
+      hessian_.col( idx ) = hessian_.row( idx ).transpose();
+      hessian_( idx, idx ) += regularization;
+
+      lower_( idx ) = lower;
+      upper_( idx ) = std::max( lower, upper );
+
+      /// the rest of the warm start is still feasible
+      solution_( idx ) = std::min( std::max( solution_( idx ), lower_( idx ) ), upper_( idx ) );
+      state_[ idx ] = pinned( idx ) ? AT_LOWER : FREE;
+    }
+
+    /// A thruster with an empty range never leaves its limit (e.g. it is disabled)
+    bool pinned( int const & idx ) const
+    {
+      return lower_( idx ) == upper_( idx );
+    }
+
+    int size() const
+    {
+      return solution_.rows();
+    }
+
+    /// Number of thrusters at one of their limits in the last solution, not counting pinned thrusters
+    int saturated() const
+    {
+      return saturated_;
+    }
+
+    int iterations() const
+    {
+      return iterations_;
+    }
+
+    /** 
+     * @param axis_vals Desired axis values t
+     * @param thrust Output thruster values
+     */
+    template<class __ThrusterVector>
+    void solve( AxisVector const & axis_vals, __ThrusterVector & thrust )
+    {
+      int const size = solution_.rows();
+      linear_.noalias() = -gradient_ * axis_vals;
+
+      /// the last solution is feasible, and the thrusters that were saturated probably still are
+      ThrusterVector & u = solution_;
+      int const max_iterations = 4 * size + 8;
+      
+      for( iterations_ = 0; iterations_ < max_iterations; ++iterations_ )
+	{
+	  // ################################################################
+	  // Minimize over the free thrusters, holding the others at their limits
+	  // ################################################################
+	  free_.clear();
+	  for( int idx = 0; idx < size; ++idx )
+	    {
+	      if( state_[ idx ] == FREE )
+		free_.push_back( idx );
+	    }
+	  int const num_free = free_.size();
+
+	  if( num_free )
+	    {
+	      free_hessian_.resize( num_free, num_free );
+	      free_rhs_.resize( num_free );
+	      for( int row = 0; row < num_free; ++row )
+		{
+		  /// -( g_f + H_fa u_a ) = -( g + H u )_f + H_ff u_f
+		  free_rhs_( row ) = -linear_( free_[ row ] ) - hessian_.row( free_[ row ] ).dot( u );
+		  for( int col = 0; col < num_free; ++col )
+		    {
+		      free_hessian_( row, col ) = hessian_( free_[ row ], free_[ col ] );
+		      free_rhs_( row ) += free_hessian_( row, col ) * u( free_[ col ] );
+		    }
+		}
+	      ldlt_.compute( free_hessian_ );
+	      free_solution_ = ldlt_.solve( free_rhs_ );
+	    }
+	  
+	  // ################################################################
+	  // Step towards the subproblem's solution until a thruster hits a limit
+	  // ################################################################
+	  double step = 1.0;
+	  int blocking_idx = -1;
+	  BoundState blocking_state = FREE;
+	  for( int row = 0; row < num_free; ++row )
+	    {
+	      int const idx = free_[ row ];
+	      double const target = free_solution_( row );
+	      if( target > upper_( idx ) && ( upper_( idx ) - u( idx ) ) < step * ( target - u( idx ) ) )
+		{
+		  step = ( upper_( idx ) - u( idx ) ) / ( target - u( idx ) );
+		  blocking_idx = idx;
+		  blocking_state = AT_UPPER;
+		}
+	      else if( target < lower_( idx ) && ( lower_( idx ) - u( idx ) ) > step * ( target - u( idx ) ) )
+		{
+		  step = ( lower_( idx ) - u( idx ) ) / ( target - u( idx ) );
+		  blocking_idx = idx;
+		  blocking_state = AT_LOWER;
+		}
+	    }
+
+	  for( int row = 0; row < num_free; ++row )
+	    {
+	      int const idx = free_[ row ];
+	      u( idx ) += step * ( free_solution_( row ) - u( idx ) );
+	    }
+	  
+	  if( blocking_idx >= 0 )
+	    {
+	      u( blocking_idx ) = ( blocking_state == AT_UPPER ) ? upper_( blocking_idx ) : lower_( blocking_idx );
+	      state_[ blocking_idx ] = blocking_state;
+	      continue;
+	    }
+
+	  // ################################################################
+	  // Release the saturated thruster that most wants to come off its limit
+	  // ################################################################
+	  double max_violation = Eigen::NumTraits<double>::dummy_precision();
+	  int release_idx = -1;
+	  for( int idx = 0; idx < size; ++idx )
+	    {
+	      if( state_[ idx ] == FREE || pinned( idx ) )
+		continue;
+	      
+	      double const gradient = linear_( idx ) + hessian_.row( idx ).dot( u );
+	      /// a thruster at its lower limit should only want to go lower, and vice versa
+	      double const violation = ( state_[ idx ] == AT_LOWER ) ? -gradient : gradient;
+	      if( violation > max_violation )
+		{
+		  max_violation = violation;
+		  release_idx = idx;
+		}
+	    }
+	  
+	  if( release_idx < 0 )
+	    break;
+	  
+	  state_[ release_idx ] = FREE;
+	}
+
+      if( iterations_ == max_iterations )
+	ROS_WARN_THROTTLE( 1.0, "Thrust allocation did not converge in %d iterations.", max_iterations );
+
+      saturated_ = 0;
+      for( int idx = 0; idx < size; ++idx )
+	{
+	  if( state_[ idx ] != FREE && !pinned( idx ) )
+	    ++saturated_;
+	}
+      
+      thrust = u;
+    }
+  };
+
+} // uscauv
+
+#endif // USCAUV_AUVPHYSICS_BOUNDEDALLOCATION
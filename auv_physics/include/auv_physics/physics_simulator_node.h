@@ -299,7 +299,7 @@ class PhysicsSimulatorNode: public BaseNode, public MultiReconfigure
       }
         
     /// get density at room temperature
-    water_density_ = water_density_lookup_.lookupClosestSlow( 20.0 );
+    water_density_ = water_density_lookup_.lookupLinear( 20.0 );
 
     XmlRpc::XmlRpcValue dynamics_xml;
     if (! nh.getParam( "model/dynamics", dynamics_xml ) )
@@ -524,7 +524,7 @@ class PhysicsSimulatorNode: public BaseNode, public MultiReconfigure
     /// TODO: Step simulation before applying water density change. 
     
     /// Get the water density at this temperature
-    water_density_ = water_density_lookup_.lookupClosestSlow( msg->data );
+    water_density_ = water_density_lookup_.lookupLinear( msg->data );
     
     return;
   }
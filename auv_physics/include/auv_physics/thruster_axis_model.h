@@ -56,7 +56,11 @@
 #include <auv_msgs/MotorPowerArray.h>
 #include <geometry_msgs/Wrench.h>
 
+#include <unordered_map>
+#include <deque>
+
 #include <auv_physics/ThrusterModelConfig.h>
+#include <auv_physics/bounded_allocation.h>
 
 namespace uscauv
 {
@@ -132,9 +136,21 @@ namespace uscauv
   class ThrusterModelSimpleLookup : public ThrusterModelBase
   {
   private:
+    /**
+     * Number of evenly spaced powers that the power-force map is resampled at. The grid misses each
+     * corner of the map by at most a quarter of the grid step times the change in slope there, so
+     * the error halves each time this doubles.
+     */
+    static unsigned int const POWER_SAMPLES = 1024;
+    
     uscauv::LookupTable<double, double> power_to_force_;
+    uscauv::UniformLookupTable<double, double> power_to_force_grid_;
+    uscauv::LookupTable<double, double> force_to_power_;
+    /// false if the power-force map isn't monotone, in which case forceToPower() picks the closest entry
+    bool invertible_;
     
   public:
+  ThrusterModelSimpleLookup(): invertible_( false ) {}
 
     virtual int load(std::string const & thruster_link, _XmlVal & xml_desc, std::string const & cm_link = uscauv::defaults::CM_LINK)
     {
@@ -143,18 +159,34 @@ namespace uscauv
 	  return -1;
 	}
 
-      if( power_to_force_.fromXmlRpc( xml_desc, "power", "force" ) )
+      if( power_to_force_.fromXmlRpc( xml_desc, "power", "force" ) || !power_to_force_.size() )
 	{
 	  ROS_WARN( "Failed to load power-force map for thruster." );
 	  return -1;
 	}
 
+      power_to_force_grid_.resample( power_to_force_, POWER_SAMPLES );
+
+      invertible_ = !power_to_force_.invert( force_to_power_ );
+      if( !invertible_ )
+	{
+	  ROS_WARN( "Power-force map for thruster [ %s ] is not monotone. Force to power will be approximate.",
+		    thruster_link.c_str() );
+	  force_to_power_ = uscauv::LookupTable<double, double>( power_to_force_.value_, power_to_force_.key_ );
+	}
+
       return 0;
     }
     
     double powerToForce(double const & power ) const
     {
-      return power_to_force_.lookupClosestSlow( power );
+      return power_to_force_grid_.lookup( power );
+    }
+
+    /// Power that produces the given force, for feedforward
+    double forceToPower(double const & force ) const
+    {
+      return invertible_ ? force_to_power_.lookupLinear( force ) : force_to_power_.lookupClosestSlow( force );
     }
     
   };
@@ -166,6 +198,7 @@ namespace uscauv
     auv_physics::ThrusterModelConfig config_;
     
   public:
+  ReconfigurableThrusterModel(): config_( auv_physics::ThrusterModelConfig::__getDefault__() ) {}
     
     /// Same as base class, but direction can be inverted
     tf::Vector3 getThrustDir() const 
@@ -178,10 +211,24 @@ namespace uscauv
       double total = value + config_.trim;
       if ( std::fabs(total) < config_.floor_mag ) return 0;
       if( config_.use_clamp )
-	uscauv::clamp( total, config_.clamp_upper, config_.clamp_lower );
+	total = uscauv::clamp( total, config_.clamp_upper, config_.clamp_lower );
       return total;
     }
 
+    /// Range of thruster values that applyConstraints() won't clamp, limited to +/- max_power
+    void getThrustLimits( double const & max_power, double & lower, double & upper ) const
+    {
+      upper = max_power;
+      lower = -max_power;
+      if( config_.use_clamp )
+	{
+	  upper = std::min( upper, config_.clamp_upper );
+	  lower = std::max( lower, config_.clamp_lower );
+	}
+      upper -= config_.trim;
+      lower -= config_.trim;
+    }
+
     bool getEnabled() const
     {
       return config_.enable;
@@ -194,6 +241,18 @@ namespace uscauv
 
   };
  
+  /// A thruster was disabled or enabled, and what the allocation could still do afterwards
+  struct AllocationEvent
+  {
+    ros::Time stamp_;
+    std::string thruster_;
+    bool enabled_;
+    /// number of axes that the enabled thrusters can still control independently
+    int rank_;
+    /// axes that can no longer be commanded exactly
+    std::string unreachable_axes_;
+  };
+  
   template<class __ThrusterModel>
     class ThrusterAxisModel
     {
@@ -211,14 +270,45 @@ namespace uscauv
 
       _NamedThrusterMap all_thruster_models_;
       _NamedThrusterMap active_thruster_models_;
+
+      /**
+       * Active thrusters in the order of the matrix columns. Rebuilt along with the matrix, so that
+       * nothing between the incoming and outgoing messages has to look up a name. Disabled thrusters
+       * keep their index, but their column is zeroed and the allocation holds them at zero.
+       */
+      std::vector<_ReconfigurableThrusterModel> active_thrusters_;
+      std::vector<std::string> active_thruster_names_;
+      std::unordered_map<std::string, int> active_thruster_index_;
+      std::vector<bool> thruster_enabled_;
+      /// thruster_to_axis_ before disabled thrusters are zeroed
+      Eigen::Matrix<double, 6, Eigen::Dynamic> thruster_columns_;
+
+      /// most recent enable/disable events, oldest first
+      std::deque<AllocationEvent> allocation_events_;
+      static unsigned int const MAX_ALLOCATION_EVENTS = 64;
+      
+      /// workspace
+      ThrusterVector thruster_vals_, thruster_force_;
     
       Eigen::Matrix<double, 6, Eigen::Dynamic> thruster_to_axis_;
+      /// least squares solution operator of thruster_to_axis_, from its QR decomposition
+      Eigen::Matrix<double, Eigen::Dynamic, 6> axis_to_thruster_;
+      /// thruster_to_axis_ * axis_to_thruster_ - I. Only needed if some axes can't be reached.
+      Eigen::Matrix<double, 6, 6> axis_residual_;
+      bool full_rank_;
+
+      /// allocation that respects the thrusters' limits
+      uscauv::BoundedAllocation bounded_allocation_;
+      AxisVector axis_weights_;
+      double max_power_;
+      double regularization_;
     
       std::string param_ns_;
     
     public:
     ThrusterAxisModel(std::string const & param_ns = "model/thrusters"): 
-      param_ns_( param_ns )
+      full_rank_( false ), axis_weights_( AxisVector::Ones() ), max_power_( 100 ),
+	regularization_( 1e-6 ), param_ns_( param_ns )
       {}
     
       virtual void load(std::string const & tf_prefix = "robot/thrusters",
@@ -239,76 +329,170 @@ namespace uscauv
       /// Find a thruster combination to achieve the desired axis vals using least squares
       ThrusterVector AxisToThruster( AxisVector const & axis_vals)
       {
-	ThrusterVector const thrust =  thruster_to_axis_.colPivHouseholderQr().solve(axis_vals);
+	ThrusterVector const thrust = axis_to_thruster_ * axis_vals;
       
-     
-	if( !(thruster_to_axis_*thrust).isApprox( axis_vals ))
+	/// with all six axes reachable the solution is exact
+	if( !full_rank_ )
 	  {
-	    double const mse = ( thruster_to_axis_ * thrust - axis_vals ).norm() / axis_vals.norm();
-	    ROS_ERROR("Requested axis values have no solution [ error %f ]!", mse );
+	    double const error = ( axis_residual_ * axis_vals ).norm();
+	    if( error > Eigen::NumTraits<double>::dummy_precision() * axis_vals.norm() )
+	      {
+		double const mse = error / axis_vals.norm();
+		ROS_ERROR("Requested axis values have no solution [ error %f ]!", mse );
+	      }
 	  }
 	return thrust;
       }
+
+      /**
+       * Find a thruster combination that stays within every thruster's limits. If the desired
+       * axis vals can't be reached, the error is spread over the axes in inverse order of their weights.
+       */
+      ThrusterVector AxisToThrusterBounded( AxisVector const & axis_vals )
+      {
+	ThrusterVector thrust;
+	bounded_allocation_.solve( axis_vals, thrust );
+	return thrust;
+      }
+
+      /** 
+       * @param axis_weights Priority of each axis when the thrusters saturate
+       * @param max_power Limit on the magnitude of any thruster's motor power
+       * @param regularization Penalty on total motor power
+       */
+      void setAllocationParams( AxisVector const & axis_weights, double const & max_power,
+				double const & regularization )
+      {
+	axis_weights_ = axis_weights;
+	max_power_ = max_power;
+	regularization_ = regularization;
+	updateBoundedAllocation();
+      }
     
-      /// This function implicitly assumes that thruster_models_ is sorted as it was when load() was called.
-      auv_msgs::MotorPowerArray AxisToMotorArray( AxisVector const & axis_vals )
-	{
-	  ThrusterVector const thruster_vals = AxisToThruster( axis_vals );
+      /// Number of active thrusters, which is the size of every thruster vector
+      unsigned int getNumActiveThrusters() const
+      {
+	return active_thrusters_.size();
+      }
 
-	  auv_msgs::MotorPowerArray motors;
+      /// Names of the active thrusters, by index
+      std::vector<std::string> const & getActiveThrusterNames() const
+      {
+	return active_thruster_names_;
+      }
+
+      bool getThrusterEnabled( unsigned int const & idx ) const
+      {
+	return thruster_enabled_[ idx ];
+      }
+
+      std::deque<AllocationEvent> const & getAllocationEvents() const
+      {
+	return allocation_events_;
+      }
+
+      /// Index of an active thruster, or -1 if it isn't active
+      int getActiveThrusterIndex( std::string const & name ) const
+      {
+	std::unordered_map<std::string, int>::const_iterator index_it = active_thruster_index_.find( name );
+	return ( index_it == active_thruster_index_.end() ) ? -1 : index_it->second;
+      }
+
+      /** 
+       * Allocate the axis vals to the active thrusters and apply each thruster's constraints
+       * 
+       * @param axis_vals Desired axis values
+       * @param motor_powers Output motor power for each active thruster, by index
+       */
+      void AxisToMotorPowers( AxisVector const & axis_vals, ThrusterVector & motor_powers )
+      {
+	bounded_allocation_.solve( axis_vals, motor_powers );
 	
-	  int row_idx = 0;
-	  for(typename _NamedThrusterMap::const_iterator thruster_it = active_thruster_models_.begin();
-	      thruster_it != active_thruster_models_.end(); ++thruster_it, ++row_idx)
-	    {
-	      auv_msgs::MotorPower mp;
-	      mp.name = thruster_it->first;
-	      mp.power = thruster_it->second.applyConstraints( thruster_vals(row_idx, 0) );
-	      motors.motors.push_back(mp);
-	    }
-	  return motors;
-	}
+	for( unsigned int idx = 0; idx < active_thrusters_.size(); ++idx )
+	  motor_powers( idx ) = thruster_enabled_[ idx ] ? active_thrusters_[ idx ].applyConstraints( motor_powers( idx ) ) : 0;
+      }
 
       /// only works if thruster model has powertoforce() defined
-      geometry_msgs::Wrench MotorArrayToWrench( auv_msgs::MotorPowerArray const & motor_levels)
+      AxisVector MotorPowersToAxis( ThrusterVector const & motor_powers )
+      {
+	ROS_ASSERT( motor_powers.rows() == int( active_thrusters_.size() ) );
+
+	thruster_force_.resize( active_thrusters_.size() );
+	for( unsigned int idx = 0; idx < active_thrusters_.size(); ++idx )
+	  thruster_force_( idx ) = active_thrusters_[ idx ].powerToForce( motor_powers( idx ) );
+	
+	return ThrusterToAxis( thruster_force_ );
+      }
+
+      /// Attach the active thrusters' names to their motor powers
+      auv_msgs::MotorPowerArray MotorPowersToMotorArray( ThrusterVector const & motor_powers ) const
 	{
-	  std::map<std::string, double> motor_power_levels;
-	  for( auv_msgs::MotorPower const & motor: motor_levels.motors )
-	    {
-	      motor_power_levels.insert( std::make_pair( motor.name, motor.power ) );
-	    }
-	  
-	  ThrusterVector thruster_force; 
-	  thruster_force.resize( active_thruster_models_.size(), 1 );
+	  auv_msgs::MotorPowerArray motors;
+	  motors.motors.resize( active_thrusters_.size() );
 	  
-	  unsigned int thruster_idx = 0;
-	  for( typename _NamedThrusterMap::value_type const & thruster : active_thruster_models_ )
+	  for( unsigned int idx = 0; idx < active_thrusters_.size(); ++idx )
 	    {
-	      std::map<std::string, double>::const_iterator power_it = motor_power_levels.find( thruster.first );
-	      if( power_it != motor_power_levels.end() )
-		{
-		  thruster_force( thruster_idx ) = thruster.second.powerToForce( power_it->second );
-		}
-	      else
-		{
-		  thruster_force( thruster_idx ) = 0;
-		}
-	    
-	      ++thruster_idx;
+	      motors.motors[ idx ].name = active_thruster_names_[ idx ];
+	      motors.motors[ idx ].power = motor_powers( idx );
 	    }
+	  return motors;
+	}
+
+      /** 
+       * Resolve a motor array's names to the active thrusters' indices. Thrusters that aren't
+       * in the array get zero power.
+       * 
+       * @return Number of motors in the array that aren't active thrusters
+       */
+      int MotorArrayToMotorPowers( auv_msgs::MotorPowerArray const & motor_levels, ThrusterVector & motor_powers ) const
+      {
+	motor_powers.setZero( active_thrusters_.size() );
 
-	  AxisVector wrench_on_body = ThrusterToAxis( thruster_force );
-	  geometry_msgs::Wrench wrench_on_body_msg;
-	  wrench_on_body_msg.force.x = wrench_on_body(0);
-	  wrench_on_body_msg.force.y = wrench_on_body(1);
-	  wrench_on_body_msg.force.z = wrench_on_body(2);
-	  wrench_on_body_msg.torque.x = wrench_on_body(3);
-	  wrench_on_body_msg.torque.y = wrench_on_body(4);
-	  wrench_on_body_msg.torque.z = wrench_on_body(5);
+	int unknown = 0;
+	for( unsigned int motor_idx = 0; motor_idx < motor_levels.motors.size(); ++motor_idx )
+	  {
+	    auv_msgs::MotorPower const & motor = motor_levels.motors[ motor_idx ];
 	    
-	  return wrench_on_body_msg;
+	    /// messages from AxisToMotorArray() are already in index order
+	    int const idx = ( motor_idx < active_thruster_names_.size() && active_thruster_names_[ motor_idx ] == motor.name ) ?
+	      motor_idx : getActiveThrusterIndex( motor.name );
+
+	    if( idx < 0 )
+	      {
+		++unknown;
+		continue;
+	      }
+	    motor_powers( idx ) = motor.power;
+	  }
+	return unknown;
       }
     
+      auv_msgs::MotorPowerArray AxisToMotorArray( AxisVector const & axis_vals )
+	{
+	  AxisToMotorPowers( axis_vals, thruster_vals_ );
+	  return MotorPowersToMotorArray( thruster_vals_ );
+	}
+
+      /// only works if thruster model has powertoforce() defined
+      geometry_msgs::Wrench MotorArrayToWrench( auv_msgs::MotorPowerArray const & motor_levels)
+	{
+	  MotorArrayToMotorPowers( motor_levels, thruster_vals_ );
+	  return AxisToWrenchMsg( MotorPowersToAxis( thruster_vals_ ) );
+	}
+
+    static geometry_msgs::Wrench AxisToWrenchMsg( AxisVector const & wrench_on_body )
+    {
+      geometry_msgs::Wrench wrench_on_body_msg;
+      wrench_on_body_msg.force.x = wrench_on_body(0);
+      wrench_on_body_msg.force.y = wrench_on_body(1);
+      wrench_on_body_msg.force.z = wrench_on_body(2);
+      wrench_on_body_msg.torque.x = wrench_on_body(3);
+      wrench_on_body_msg.torque.y = wrench_on_body(4);
+      wrench_on_body_msg.torque.z = wrench_on_body(5);
+      
+      return wrench_on_body_msg;
+    }
+    
     static AxisVector constructAxisVector(double const & x,  double const & y, 
 					  double const & z,  double const & t1, 
 					  double const & t2, double const & t3)
@@ -357,29 +541,175 @@ namespace uscauv
 
     void computeThrusterAxisMatrix()
     {
-      thruster_to_axis_.resize(6, active_thruster_models_.size() );
+      indexActiveThrusters();
+      
+      thruster_columns_.resize(6, active_thrusters_.size() );
+
+      for( unsigned int col_idx = 0; col_idx < active_thrusters_.size(); ++col_idx )
+	{
+	  thruster_columns_.col( col_idx ) = computeThrusterColumn( active_thrusters_[ col_idx ] );
+	  ROS_DEBUG_STREAM("Thruster [ " << active_thruster_names_[ col_idx ] << " ] (" << 
+			   thruster_columns_.col( col_idx ).transpose() << ")");
+	}
+
+      thruster_to_axis_ = thruster_columns_;
+      for( unsigned int col_idx = 0; col_idx < active_thrusters_.size(); ++col_idx )
+	{
+	  if( !thruster_enabled_[ col_idx ] )
+	    thruster_to_axis_.col( col_idx ).setZero();
+	}
+      ROS_INFO_STREAM("Thruster to axis:" << std::endl << thruster_to_axis_);
+
+      updateBoundedAllocation();
+      
+      int const rank = updateLeastSquares();
+      if( rank < 6 )
+	ROS_WARN( "Thrusters only span %d of 6 axes.", rank );
+    }
+
+    /** 
+     * Apply a new config to one thruster without rebuilding everything else. The thruster's column and
+     * limits are replaced in place. Disabling a thruster zeroes its column and pins it to zero in the
+     * allocation, and is recorded as an allocation event, as is enabling it again.
+     * 
+     * @param idx Index of the thruster
+     * @param config New config
+     */
+    void updateThruster( unsigned int const & idx, auv_physics::ThrusterModelConfig const & config )
+    {
+      ROS_ASSERT( idx < active_thrusters_.size() );
+      
+      _ReconfigurableThrusterModel & thruster = active_thrusters_[ idx ];
+      bool const was_enabled = thruster_enabled_[ idx ];
+      
+      thruster.updateConfig( config );
+      thruster_enabled_[ idx ] = thruster.getEnabled();
+
+      thruster_columns_.col( idx ) = computeThrusterColumn( thruster );
+      if( thruster_enabled_[ idx ] )
+	thruster_to_axis_.col( idx ) = thruster_columns_.col( idx );
+      else
+	thruster_to_axis_.col( idx ).setZero();
+
+      double lower, upper;
+      getAllocationLimits( idx, lower, upper );
+      bounded_allocation_.updateThruster( idx, thruster_columns_, axis_weights_, regularization_, lower, upper );
+      
+      int const rank = updateLeastSquares();
+
+      if( was_enabled != thruster_enabled_[ idx ] )
+	logAllocationEvent( idx, rank );
+    }
+
+    static AxisVector computeThrusterColumn( _ReconfigurableThrusterModel const & thruster )
+    {
+      AxisVector col;
+      Eigen::Vector3d thrust_dir_unit, cm_to_thruster, torque;
+      tf::vectorTFToEigen( thruster.getPosition(), cm_to_thruster );
+      tf::vectorTFToEigen( thruster.getThrustDir(), thrust_dir_unit );
+	  
+      /// not actually torque unless thrust_dir_unit is some unit of force
+      /// could also be something like linear velocity -> angular velocity
+      torque = cm_to_thruster.cross(thrust_dir_unit);
+
+      col << thrust_dir_unit, torque;
+      return col;
+    }
+
+    /** 
+     * The QR solve is linear in the axis values, so solving for each axis once gives the matrix
+     * that AxisToThruster() applies. It only changes when the thrusters are reconfigured.
+     * 
+     * @return Rank of thruster_to_axis_
+     */
+    int updateLeastSquares()
+    {
+      /// Eigen can't decompose an empty matrix
+      if( active_thrusters_.empty() )
+	{
+	  axis_to_thruster_.resize( 0, 6 );
+	  axis_residual_ = -Eigen::Matrix<double, 6, 6>::Identity();
+	  full_rank_ = false;
+	  ROS_WARN( "No thrusters are enabled." );
+	  return 0;
+	}
+
+      Eigen::ColPivHouseholderQR< Eigen::Matrix<double, 6, Eigen::Dynamic> > const qr( thruster_to_axis_ );
+      axis_to_thruster_ = qr.solve( Eigen::Matrix<double, 6, 6>::Identity() );
+      axis_residual_ = thruster_to_axis_ * axis_to_thruster_ - Eigen::Matrix<double, 6, 6>::Identity();
+      full_rank_ = ( qr.rank() == 6 );
+
+      return qr.rank();
+    }
+
+    void logAllocationEvent( unsigned int const & idx, int const & rank )
+    {
+      static char const * const axis_names[6] = { "x", "y", "z", "roll", "pitch", "yaw" };
+      
+      AllocationEvent event;
+      event.stamp_ = ros::Time::now();
+      event.thruster_ = active_thruster_names_[ idx ];
+      event.enabled_ = thruster_enabled_[ idx ];
+      event.rank_ = rank;
+
+      /// an axis is reachable if commanding it alone leaves no residual
+      for( int axis = 0; axis < 6; ++axis )
+	{
+	  if( axis_residual_.col( axis ).norm() > Eigen::NumTraits<double>::dummy_precision() )
+	    event.unreachable_axes_ += ( event.unreachable_axes_.empty() ? "" : ", " ) + std::string( axis_names[ axis ] );
+	}
 
-      int col_idx = 0;
+      if( event.enabled_ )
+	ROS_INFO( "Thruster [ %s ] enabled. Allocation spans %d of 6 axes. Unreachable axes: [ %s ].",
+		  event.thruster_.c_str(), event.rank_, event.unreachable_axes_.c_str() );
+      else
+	ROS_WARN( "Thruster [ %s ] disabled. Allocation spans %d of 6 axes. Unreachable axes: [ %s ].",
+		  event.thruster_.c_str(), event.rank_, event.unreachable_axes_.c_str() );
+      
+      allocation_events_.push_back( event );
+      while( allocation_events_.size() > MAX_ALLOCATION_EVENTS )
+	allocation_events_.pop_front();
+    }
+
+    /// Lay the active thrusters out by index, in the map's (name) order
+    void indexActiveThrusters()
+    {
+      active_thrusters_.clear();
+      active_thruster_names_.clear();
+      active_thruster_index_.clear();
+      thruster_enabled_.clear();
+      
       for(typename _NamedThrusterMap::const_iterator thruster_it = active_thruster_models_.begin();
 	  thruster_it != active_thruster_models_.end(); ++thruster_it)
 	{
-	  AxisVector col;
-	  Eigen::Vector3d thrust_dir_unit, cm_to_thruster, torque;
-	  tf::vectorTFToEigen( thruster_it->second.getPosition(), cm_to_thruster );
-	  tf::vectorTFToEigen( thruster_it->second.getThrustDir(), thrust_dir_unit );
-	  
-	  /// not actually torque unless thrust_dir_unit is some unit of force
-	  /// could also be something like linear velocity -> angular velocity
-	  torque = cm_to_thruster.cross(thrust_dir_unit);
+	  active_thruster_index_[ thruster_it->first ] = active_thrusters_.size();
+	  active_thrusters_.push_back( thruster_it->second );
+	  active_thruster_names_.push_back( thruster_it->first );
+	  thruster_enabled_.push_back( thruster_it->second.getEnabled() );
+	}
+    }
 
-	  col << thrust_dir_unit, torque;
-	  ROS_DEBUG_STREAM("Thruster [ " << thruster_it->first << " ] (" << col.transpose() <<
-			   ")");
-	  
-	  thruster_to_axis_.col( col_idx ) = col;
-	  ++col_idx;
+    /// Disabled thrusters are held at zero
+    void getAllocationLimits( unsigned int const & idx, double & lower, double & upper ) const
+    {
+      if( thruster_enabled_[ idx ] )
+	active_thrusters_[ idx ].getThrustLimits( max_power_, lower, upper );
+      else
+	lower = upper = 0;
+    }
+
+    /// Thruster limits depend on the thrusters' configs, so this runs whenever they are reconfigured
+    void updateBoundedAllocation()
+    {
+      ThrusterVector lower( active_thrusters_.size() ), upper( active_thrusters_.size() );
+
+      for( unsigned int row_idx = 0; row_idx < active_thrusters_.size(); ++row_idx )
+	{
+	  getAllocationLimits( row_idx, lower( row_idx ), upper( row_idx ) );
 	}
-      ROS_INFO_STREAM("Thruster to axis:" << std::endl << thruster_to_axis_);
+
+      /// the full columns, so that enabling a thruster only has to release its limits
+      bounded_allocation_.setProblem( thruster_columns_, axis_weights_, regularization_, lower, upper );
     }
 
   };
@@ -401,6 +731,18 @@ namespace uscauv
   ReconfigurableThrusterAxisModel(std::string const & param_ns = "model/thrusters"):
     _BaseThrusterAxisModel( param_ns ),
       MultiReconfigure( param_ns ), ready_( false ) {}
+
+    /// Reconfigure requests are queued on callback_queue, for models that are used outside of the ROS callback thread
+  ReconfigurableThrusterAxisModel(std::string const & param_ns, ros::CallbackQueueInterface * callback_queue):
+    _BaseThrusterAxisModel( param_ns ),
+      MultiReconfigure( queuedNodeHandle( param_ns, callback_queue ) ), ready_( false ) {}
+
+    static ros::NodeHandle queuedNodeHandle( std::string const & ns, ros::CallbackQueueInterface * callback_queue )
+    {
+      ros::NodeHandle nh( ns );
+      nh.setCallbackQueue( callback_queue );
+      return nh;
+    }
     
     virtual void load(std::string const & tf_prefix = "robot/thrusters",
 		      std::string const & cm_link = uscauv::defaults::CM_LINK)
@@ -436,21 +778,22 @@ namespace uscauv
 
       if( !ready_ )
 	return;
+
+      /// every loaded thruster has an index, so this only has to touch one of them
+      int const idx = this->getActiveThrusterIndex( thruster_name );
+      if( idx < 0 )
+	{
+	  updateActiveThrusters();
+	  return;
+	}
       
-      updateActiveThrusters();
+      _BaseThrusterAxisModel::updateThruster( idx, config );
     }
 
+    /// Disabled thrusters stay in the layout, so that they can be brought back without a rebuild
     void updateActiveThrusters()
     {
-      this->active_thruster_models_.clear();
-
-      for( typename _BaseThrusterAxisModel::_NamedThrusterMap::value_type const & thruster : this->all_thruster_models_ )
-	{
-	  if( thruster.second.getEnabled() )
-	    {
-	      this->active_thruster_models_.insert( thruster );
-	    }
-	}
+      this->active_thruster_models_ = this->all_thruster_models_;
       
       _BaseThrusterAxisModel::computeThrusterAxisMatrix();
     }
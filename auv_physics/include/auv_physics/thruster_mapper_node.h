@@ -44,29 +44,35 @@
 
 // uscauv
 #include <uscauv_common/base_node.h>
+#include <uscauv_common/multi_reconfigure.h>
+#include <uscauv_common/command_trace.h>
 #include <auv_physics/thruster_axis_model.h>
+#include <auv_physics/ThrusterAllocationConfig.h>
 
 #include <auv_msgs/MotorPowerArray.h>
+#include <auv_msgs/TracedTwist.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Wrench.h>
 
 typedef auv_msgs::MotorPower _MotorPowerMsg;
 typedef auv_msgs::MotorPowerArray _MotorPowerArrayMsg;
+typedef auv_msgs::TracedTwist _TracedTwistMsg;
 
 typedef uscauv::ReconfigurableThrusterAxisModel<uscauv::ThrusterModelSimpleLookup> _ThrusterAxisModel;
+typedef auv_physics::ThrusterAllocationConfig _ThrusterAllocationConfig;
 
-static const double MAX_MOTOR_VAL = 100;
-
-class ThrusterMapperNode: public BaseNode
+class ThrusterMapperNode: public BaseNode, public MultiReconfigure
 {
  private:
 
   _ThrusterAxisModel thruster_axis_model_;
+  /// motor power of each active thruster, by index
+  _ThrusterAxisModel::ThrusterVector motor_powers_;
 
   /// ros
   ros::NodeHandle nh_rel_;
   ros::Publisher motor_pub_, wrench_pub_;
-  ros::Subscriber axis_sub_;
+  ros::Subscriber axis_sub_, axis_traced_sub_;
   
  public:
  ThrusterMapperNode(): BaseNode("ThrusterMapper"), thruster_axis_model_("model/thrusters"),
@@ -80,11 +86,16 @@ class ThrusterMapperNode: public BaseNode
   void spinFirst()
   {
     axis_sub_ = nh_rel_.subscribe( "axis_in", 10, &ThrusterMapperNode::axisCallback, this );
+    /// same as axis_in, but carries the command trace with the twist. Remap only one of the two.
+    axis_traced_sub_ = nh_rel_.subscribe( "axis_in_traced", 10, &ThrusterMapperNode::axisTracedCallback, this );
 
     motor_pub_ = nh_rel_.advertise<_MotorPowerArrayMsg>("motor_levels", 10);
     wrench_pub_ = nh_rel_.advertise<geometry_msgs::Wrench>("thruster_wrench", 10);
     
     thruster_axis_model_.load("robot/thrusters");
+
+    /// the model has to be loaded first, the callback gets called right away
+    addReconfigureServer<_ThrusterAllocationConfig>("allocation", &ThrusterMapperNode::allocationCallback, this );
   }  
 
   // Running spin() will cause this function to get called at the loop rate until this node is killed.
@@ -95,72 +106,55 @@ class ThrusterMapperNode: public BaseNode
 
   void axisCallback( geometry_msgs::Twist::ConstPtr const & msg )
   {
-    _ThrusterAxisModel::AxisVector desired_axis;
-    desired_axis <<
-      msg->linear.x,
-      msg->linear.y,
-      msg->linear.z,
-      msg->angular.x,
-      msg->angular.y,
-      msg->angular.z;
-
-    _MotorPowerArrayMsg motor_levels = thruster_axis_model_.AxisToMotorArray( desired_axis );
-
-    /**
-     * Normalize thrusters on the same axis to have maximum possible motor value
-     * Future versions will do this without explicitly mapping axes to thrusters
-     */
-    normalizeAxes( motor_levels );
-    
-    motor_pub_.publish( motor_levels );
-
-    /// Get predicted wrench on auv body due to firing thrusters 
-    geometry_msgs::Wrench wrench_on_body = thruster_axis_model_.MotorArrayToWrench( motor_levels );
-    wrench_pub_.publish( wrench_on_body );
-    
+    mapAxis( *msg, uscauv::_CommandTraceMsg(), ros::Time::now() );
   }
- private:
-  
-  void normalizeAxes( _MotorPowerArrayMsg & msg )
+
+  void axisTracedCallback( _TracedTwistMsg::ConstPtr const & msg )
   {
-    if( normalizeMotorPair( msg, "thruster1", "thruster2" ) ||
-	normalizeMotorPair( msg, "thruster3", "thruster4" ) ||
-	normalizeMotorPair( msg, "thruster5", "thruster6" ) )
-      ROS_ERROR("Failed to normalize motor vals.");
+    mapAxis( msg->twist, msg->trace, ros::Time::now() );
   }
 
-  int normalizeMotorPair( _MotorPowerArrayMsg & msg, std::string const & motor1, std::string const & motor2 )
+  /** 
+   * @param trace Trace of the command that twist came from, passed on with the motor levels
+   * @param received Time that twist was received, for the trace
+   */
+  void mapAxis( geometry_msgs::Twist const & twist, uscauv::_CommandTraceMsg const & trace, ros::Time const & received )
   {
-    int motor1_idx = getMotorIndex(msg, motor1), motor2_idx = getMotorIndex(msg, motor2);
-    if( motor1_idx < 0 || motor2_idx < 0)
-      return -1;
-
-    double & power1 = msg.motors[ motor1_idx ].power;
-    double & power2 = msg.motors[ motor2_idx ].power;
-
-    double max = std::max( fabs( power1), fabs( power2 ) );
+    _ThrusterAxisModel::AxisVector desired_axis;
+    desired_axis <<
+      twist.linear.x,
+      twist.linear.y,
+      twist.linear.z,
+      twist.angular.x,
+      twist.angular.y,
+      twist.angular.z;
+
+    /// Stays within the thrusters' limits, giving up on the lowest priority axes first
+    thruster_axis_model_.AxisToMotorPowers( desired_axis, motor_powers_ );
+    
+    _MotorPowerArrayMsg motor_array = thruster_axis_model_.MotorPowersToMotorArray( motor_powers_ );
 
-    if(max <= MAX_MOTOR_VAL )
-      return 0;
+    if( uscauv::isTraced( trace ) )
+      {
+	motor_array.trace = trace;
+	uscauv::appendCommandHop( motor_array.trace, uscauv::_CommandHopMsg::THRUSTER_MAPPER, received );
+      }
     
-    power1 *= MAX_MOTOR_VAL/max;
-    power2 *= MAX_MOTOR_VAL/max;
+    motor_pub_.publish( motor_array );
+
+    /// Get predicted wrench on auv body due to firing thrusters 
+    geometry_msgs::Wrench wrench_on_body = 
+      _ThrusterAxisModel::AxisToWrenchMsg( thruster_axis_model_.MotorPowersToAxis( motor_powers_ ) );
+    wrench_pub_.publish( wrench_on_body );
     
-    return 0;
   }
 
-  int getMotorIndex( _MotorPowerArrayMsg & msg, std::string const & name )
+  void allocationCallback( _ThrusterAllocationConfig const & config )
   {
-    unsigned int idx = 0;
-    
-    for( _MotorPowerMsg & motor : msg.motors )
-      {
-	if( motor.name == name )
-	  return idx;
-	++idx;
-      }
-    
-    return -1;
+    thruster_axis_model_.setAllocationParams
+      ( _ThrusterAxisModel::constructAxisVector( config.weight_x, config.weight_y, config.weight_z,
+						 config.weight_roll, config.weight_pitch, config.weight_yaw ),
+	config.max_power, config.regularization );
   }
 
 };
@@ -151,6 +151,14 @@ class OpticalFlowNode: public BaseNode, public ImageTransceiver, public MultiRec
 			      match_status, err );
 
 
+    /// Everything past this point only feeds the debug image
+    if( !hasImageSubscribers( "image_debug" ) )
+      {
+	new_image.copyTo( prev_image_ );
+	prev_features_ = new_features;
+	return;
+      }
+
     // ################################################################
     // Draw output image and publish ##################################
     // ################################################################
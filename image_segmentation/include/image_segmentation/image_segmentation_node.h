@@ -81,14 +81,15 @@ class ImageSegmentationNode: public BaseNode, public ImageTransceiver
 
   void imageCallback( _CvImage::ConstPtr const & msg)
   {
-    cv::Mat input = msg->image;
-
-    _CvImage::Ptr output = boost::make_shared<_CvImage>
-      (msg->header, sensor_msgs::image_encodings::BGR8 );
+    /// Segmentation is expensive and its only output is the image, so skip it when nobody is listening
+    publishImageDeferred("image_segmented", [&]()
+			 {
+			   _CvImage::Ptr output = boost::make_shared<_CvImage>
+			     (msg->header, sensor_msgs::image_encodings::BGR8 );
     
-    output->image = segmentation.segment(input);
-
-    publishImage("image_segmented", output);
+			   output->image = segmentation.segment(msg->image);
+			   return output;
+			 });
   }
 
 };
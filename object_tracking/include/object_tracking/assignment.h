@@ -0,0 +1,65 @@
+/***************************************************************************
+ *  include/object_tracking/assignment.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_ASSIGNMENT
+#define USCAUV_OBJECTTRACKING_ASSIGNMENT
+
+#include <vector>
+
+/// Eigen
+#include <Eigen/Dense>
+
+namespace uscauv
+{
+
+  /** 
+   * Solve the rectangular linear assignment problem with the Hungarian algorithm
+   * (shortest augmenting paths with potentials, O(n^2 m) for n = min(rows, cols)).
+   * Every row is assigned to a distinct column if rows <= cols, and vice versa otherwise.
+   * To forbid a pairing, give it a cost much larger than any allowed one and discard it afterwards.
+   * 
+   * @param cost Cost of assigning row i to column j. Costs may be negative.
+   * @param row_assignment Column assigned to each row, or -1 if the row was left unassigned
+   * 
+   * @return Total cost of the assignment
+   */
+  double solveAssignment( Eigen::MatrixXd const & cost, std::vector<int> & row_assignment );
+  
+} // uscauv
+
+#endif // USCAUV_OBJECTTRACKING_ASSIGNMENT
@@ -0,0 +1,201 @@
+/***************************************************************************
+ *  include/object_tracking/kalman_bank.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_KALMANBANK
+#define USCAUV_OBJECTTRACKING_KALMANBANK
+
+/// object tracking
+#include <object_tracking/kalman_filter.h>
+
+namespace uscauv
+{
+
+  /**
+   * N linear Kalman filters with the same dimensions, stored as structure-of-arrays: element i of
+   * every filter's state is contiguous, and so is element (i,j) of every filter's covariance.
+   * Motion models predict the whole bank in one sweep of row operations, which run over all of the
+   * filters at once. Per-filter views (state(), cov()) and updates go through strided maps.
+   * 
+   * Views are invalidated when the capacity changes.
+   */
+  template<unsigned int __StateDim, typename __NumericType = double, class __UpdatePolicy = StandardKalmanUpdate>
+    class KalmanBank
+    {
+    public:
+    typedef __NumericType Scalar;
+    typedef LinearKalmanFilter<__StateDim, __NumericType, __UpdatePolicy> FilterType;
+    typedef typename FilterType::StateVector StateVector;
+    typedef typename FilterType::StateMatrix StateMatrix;
+
+    /// row i holds element i of every filter
+    typedef Eigen::Matrix<__NumericType, __StateDim, Eigen::Dynamic, Eigen::RowMajor>              StateArray;
+    /// row i*__StateDim + j holds element (i,j) of every filter
+    typedef Eigen::Matrix<__NumericType, __StateDim*__StateDim, Eigen::Dynamic, Eigen::RowMajor>  CovarianceArray;
+
+    typedef Eigen::Map<StateVector, Eigen::Unaligned, Eigen::InnerStride<> >                           StateView;
+    typedef Eigen::Map<StateVector const, Eigen::Unaligned, Eigen::InnerStride<> >                     ConstStateView;
+    typedef Eigen::Map<StateMatrix, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> >       CovarianceView;
+    typedef Eigen::Map<StateMatrix const, Eigen::Unaligned, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> > ConstCovarianceView;
+
+    private:
+    StateArray states_;
+    CovarianceArray covs_;
+    unsigned int size_;
+
+    public:
+    KalmanBank( unsigned int const & capacity = 0 ): 
+    states_( __StateDim, capacity ), covs_( __StateDim*__StateDim, capacity ), size_( 0 ) {}
+
+    unsigned int size() const { return size_; }
+    unsigned int capacity() const { return states_.cols(); }
+    bool empty() const { return size_ == 0; }
+
+    /// Grow the storage so that it can hold at least capacity filters. Never shrinks.
+    void reserve( unsigned int const & capacity )
+    {
+      if( capacity <= this->capacity() )
+	return;
+      
+      states_.conservativeResize( Eigen::NoChange, capacity );
+      covs_.conservativeResize( Eigen::NoChange, capacity );
+    }
+
+    void clear() { size_ = 0; }
+
+    /// Drop the filters from index size onwards
+    void resize( unsigned int const & size )
+    {
+      if( size < size_ )
+	size_ = size;
+    }
+    
+    void push_back( FilterType const & filter )
+    {
+      if( size_ == capacity() )
+	reserve( std::max( 1u, 2*capacity() ) );
+      
+      set( size_++, filter );
+    }
+
+    void pop_back() { --size_; }
+    
+    // ################################################################
+    // Per-filter access ##############################################
+    // ################################################################
+    
+    StateView state( unsigned int const & idx )
+    {
+      return StateView( states_.data() + idx, Eigen::InnerStride<>( capacity() ) );
+    }
+
+    ConstStateView state( unsigned int const & idx ) const
+    {
+      return ConstStateView( states_.data() + idx, Eigen::InnerStride<>( capacity() ) );
+    }
+
+    /// element (i,j) is at (i*__StateDim + j)*capacity
+    CovarianceView cov( unsigned int const & idx )
+    {
+      return CovarianceView( covs_.data() + idx, 
+			     Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>( capacity(), __StateDim*capacity() ) );
+    }
+
+    ConstCovarianceView cov( unsigned int const & idx ) const
+    {
+      return ConstCovarianceView( covs_.data() + idx,
+				  Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>( capacity(), __StateDim*capacity() ) );
+    }
+
+    /// Copy of a single filter
+    FilterType filter( unsigned int const & idx ) const
+    {
+      return FilterType( state( idx ), cov( idx ) );
+    }
+
+    void set( unsigned int const & idx, FilterType const & filter )
+    {
+      state( idx ) = filter.state_;
+      cov( idx ) = filter.cov_;
+    }
+
+    /// Copy filter src over filter dst, e.g. to compact the bank
+    void move( unsigned int const & src, unsigned int const & dst )
+    {
+      states_.col( dst ) = states_.col( src );
+      covs_.col( dst ) = covs_.col( src );
+    }
+
+    // ################################################################
+    // Filtering ######################################################
+    // ################################################################
+
+    /// Predict every filter with a motion model policy (e.g. ConstantVelocityModel) and no control input
+    template< class __MotionModel >
+    void predict( __MotionModel const & model, StateMatrix const & process_noise )
+    {
+      if( empty() )
+	return;
+      
+      model.template predictBank<KalmanBank>( states_, covs_, size_ );
+
+      /// Process noise is usually diagonal, so only touch the rows of nonzero elements
+      for(unsigned int i = 0; i < __StateDim; ++i )
+	for(unsigned int j = 0; j < __StateDim; ++j )
+	  {
+	    if( process_noise( i, j ) != 0 )
+	      covs_.row( i*__StateDim + j ).head( size_ ).array() += process_noise( i, j );
+	  }
+    }
+    
+    /// Measurement update of a single filter with the bank's update policy
+    template< unsigned int __UpdateDim>
+    void update( unsigned int const & idx,
+		 typename FilterType::template Update<__UpdateDim>::VectorType const & update,
+		 typename FilterType::template Update<__UpdateDim>::CovarianceType const & update_cov,
+		 typename FilterType::template Update<__UpdateDim>::TransitionType const & C )
+    {
+      FilterType updated = filter( idx );
+      updated.template update<__UpdateDim>( update, update_cov, C );
+      set( idx, updated );
+    }
+    
+    };
+
+}
+
+#endif // USCAUV_OBJECTTRACKING_KALMANBANK
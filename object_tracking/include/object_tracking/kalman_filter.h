@@ -44,16 +44,195 @@
 
 /// Eigen
 #include <Eigen/Dense>
+#include <Eigen/Cholesky>
 
 namespace uscauv
 {
 
+  /**
+   * Measurement update policies for LinearKalmanFilter. Each one provides
+   * update<__Filter, __UpdateDim>( state, cov, z, R, C ).
+   */
+
+  /// Textbook update. Explicitly inverts the innovation covariance and uses P = (I - KC)P
+  struct StandardKalmanUpdate
+  {
+    template<class __Filter, unsigned int __UpdateDim>
+    static void update( typename __Filter::StateVector & state, typename __Filter::StateMatrix & cov,
+			typename __Filter::template Update<__UpdateDim>::VectorType const & z,
+			typename __Filter::template Update<__UpdateDim>::CovarianceType const & R,
+			typename __Filter::template Update<__UpdateDim>::TransitionType const & C )
+    {
+      typename __Filter::template Update<__UpdateDim>::GainType gain = 
+	cov*C.transpose() * (C*cov*C.transpose() + R).inverse();
+      
+      state = state + gain*( z - C*state );
+      cov = ( __Filter::StateMatrix::Identity() - gain*C)*cov;
+    }
+  };
+
+  /**
+   * Solves for the gain with an LDLT factorization of the innovation covariance instead of inverting it,
+   * and updates the covariance in Joseph form, P = (I - KC)P(I - KC)^T + KRK^T, which keeps it
+   * symmetric positive semi-definite even when the gain is slightly off.
+   */
+  struct JosephKalmanUpdate
+  {
+    template<class __Filter, unsigned int __UpdateDim>
+    static void update( typename __Filter::StateVector & state, typename __Filter::StateMatrix & cov,
+			typename __Filter::template Update<__UpdateDim>::VectorType const & z,
+			typename __Filter::template Update<__UpdateDim>::CovarianceType const & R,
+			typename __Filter::template Update<__UpdateDim>::TransitionType const & C )
+    {
+      correct<__Filter, __UpdateDim>( state, cov, z - C*state, R, C );
+    }
+
+    /// Update given the innovation directly, so that nonlinear filters can pass z - h(x) and the jacobian of h as C
+    template<class __Filter, unsigned int __UpdateDim>
+    static void correct( typename __Filter::StateVector & state, typename __Filter::StateMatrix & cov,
+			 typename __Filter::template Update<__UpdateDim>::VectorType const & innovation,
+			 typename __Filter::template Update<__UpdateDim>::CovarianceType const & R,
+			 typename __Filter::template Update<__UpdateDim>::TransitionType const & C )
+    {
+      typedef typename __Filter::template Update<__UpdateDim> _Update;
+      typedef typename __Filter::StateMatrix _StateMatrix;
+
+      /// cov is symmetric, so (C*cov)^T = cov*C^T
+      typename _Update::TransitionType const CP = C*cov;
+      typename _Update::CovarianceType const S = CP*C.transpose() + R;
+
+      /// K = P*C^T*S^-1  <=>  S*K^T = C*P
+      typename _Update::GainType const gain = S.ldlt().solve( CP ).transpose();
+      
+      state = state + gain*innovation;
+
+      _StateMatrix const I_KC = _StateMatrix::Identity() - gain*C;
+      _StateMatrix const joseph = I_KC*cov*I_KC.transpose() + gain*R*gain.transpose();
+
+      /// wipe out rounding asymmetry
+      cov = 0.5*( joseph + joseph.transpose() );
+    }
+  };
+
+  /**
+   * Motion model policies for LinearKalmanFilter::predict( model, process_noise ). Each one provides
+   * predict<__Filter>( state, cov ), which applies x = Ax and P = APA^T for its transition A, and
+   * predictBank<__Bank>( states, covs, size ), which does the same for the first size filters of a KalmanBank.
+   * The dense predict() with an explicit transition matrix is still there for other models.
+   */
+
+  /**
+   * Any transition matrix. In a KalmanBank, the covariances form a row major __StateDim x (__StateDim*capacity)
+   * matrix M with M( i, j*capacity + n ) = P_n( i, j ), so APA^T for every filter is two passes of plain
+   * matrix products: A*M, then A times each group of __StateDim consecutive covariance rows.
+   */
+  template<unsigned int __StateDim, typename __NumericType = double>
+  struct LinearMotionModel
+  {
+    typedef Eigen::Matrix<__NumericType, __StateDim, __StateDim> TransitionType;
+    TransitionType A_;
+
+  LinearMotionModel( TransitionType const & A ): A_( A ) {}
+
+    template<class __Filter>
+    void predict( typename __Filter::StateVector & state, typename __Filter::StateMatrix & cov ) const
+    {
+      state = A_*state;
+      cov = A_*cov*A_.transpose();
+    }
+
+    template<class __Bank>
+    void predictBank( typename __Bank::StateArray & states, typename __Bank::CovarianceArray & covs, 
+		      unsigned int const & size ) const
+    {
+      typedef Eigen::Matrix<__NumericType, __StateDim, Eigen::Dynamic, Eigen::RowMajor> _RowMatrix;
+      unsigned int const capacity = covs.cols();
+      
+      states.leftCols( size ) = A_ * states.leftCols( size );
+
+      /// A*P, on every column block j
+      Eigen::Map<_RowMatrix> M( covs.data(), __StateDim, __StateDim*capacity );
+      for(unsigned int j = 0; j < __StateDim; ++j )
+	M.middleCols( j*capacity, size ) = A_ * M.middleCols( j*capacity, size );
+
+      /// (A*P)*A^T, on the rows of every row i of A*P
+      for(unsigned int i = 0; i < __StateDim; ++i )
+	covs.template middleRows<__StateDim>( i*__StateDim ).leftCols( size ) = 
+	  A_ * covs.template middleRows<__StateDim>( i*__StateDim ).leftCols( size );
+    }
+  };
+
+  /**
+   * Constant velocity model with state [ position, velocity ], each __Dim long. The transition
+   * is [[I, dt*I],[0, I]], so the covariance only needs a few block additions instead of two
+   * dense matrix products.
+   */
+  template<unsigned int __Dim>
+  struct ConstantVelocityModel
+  {
+    double dt_;
+
+  ConstantVelocityModel( double const & dt ): dt_( dt ) {}
+    
+    template<class __Filter>
+    void predict( typename __Filter::StateVector & state, typename __Filter::StateMatrix & cov ) const
+    {
+      static_assert( __Filter::StateVector::RowsAtCompileTime == 2*__Dim, 
+		     "Constant velocity model needs a [ position, velocity ] state." );
+      typedef typename __Filter::StateMatrix::Scalar _Scalar;
+      _Scalar const dt = dt_;
+      
+      state.template head<__Dim>() += dt * state.template tail<__Dim>();
+
+      /// P11 += dt*(P12 + P21) + dt^2*P22, then P12 += dt*P22, P21 += dt*P22. P22 is unchanged.
+      cov.template topLeftCorner<__Dim, __Dim>() += 
+	dt * ( cov.template topRightCorner<__Dim, __Dim>() + cov.template bottomLeftCorner<__Dim, __Dim>() ) +
+	( dt * dt ) * cov.template bottomRightCorner<__Dim, __Dim>();
+      cov.template topRightCorner<__Dim, __Dim>() += dt * cov.template bottomRightCorner<__Dim, __Dim>();
+      cov.template bottomLeftCorner<__Dim, __Dim>() += dt * cov.template bottomRightCorner<__Dim, __Dim>();
+    }
+
+    /// Same as predict(), with each block element done as a row operation over all of the filters
+    template<class __Bank>
+    void predictBank( typename __Bank::StateArray & states, typename __Bank::CovarianceArray & covs, 
+		      unsigned int const & size ) const
+    {
+      typedef typename __Bank::Scalar _Scalar;
+      _Scalar const dt = dt_;
+      unsigned int const dim = 2*__Dim;
+
+      states.template topRows<__Dim>().leftCols( size ) += dt * states.template bottomRows<__Dim>().leftCols( size );
+
+      /// Row i*dim + j of covs is element (i,j). Each block element is one contiguous row over all filters.
+      unsigned int const stride = covs.cols();
+      _Scalar * const data = covs.data();
+      for(unsigned int a = 0; a < __Dim; ++a )
+	for(unsigned int b = 0; b < __Dim; ++b )
+	  {
+	    _Scalar * const P11 = data + ( a*dim + b )*stride;
+	    _Scalar * const P12 = data + ( a*dim + __Dim + b )*stride;
+	    _Scalar * const P21 = data + ( ( __Dim + a )*dim + b )*stride;
+	    _Scalar const * const P22 = data + ( ( __Dim + a )*dim + __Dim + b )*stride;
+
+	    for(unsigned int n = 0; n < size; ++n )
+	      {
+		_Scalar const dt_P22 = dt * P22[n];
+		P11[n] += dt * ( P12[n] + P21[n] + dt_P22 );
+		P12[n] += dt_P22;
+		P21[n] += dt_P22;
+	      }
+	  }
+    }
+  };
+
   /**
    * A linear Kalman filter for which the dimensions of the state, control inputs, and measurement inputs are known at compile time.
    * Dimensions can also be set to Eigen::Dynamic
+   * 
+   * __UpdatePolicy selects how measurement updates are computed (StandardKalmanUpdate or JosephKalmanUpdate)
    */
 
-  template<unsigned int __StateDim, typename __NumericType = double>
+  template<unsigned int __StateDim, typename __NumericType = double, class __UpdatePolicy = StandardKalmanUpdate>
     class LinearKalmanFilter
     {
     public:
@@ -127,17 +306,21 @@ namespace uscauv
       state_ = A*state_ + B*control;
       cov_ = A* cov_ * A.transpose() + control_cov;
     }
+
+    /// Predict with a structured motion model policy (e.g. ConstantVelocityModel) and no control input
+    template< class __MotionModel >
+    void predict( __MotionModel const & model, StateMatrix const & process_noise )
+    {
+      model.template predict<LinearKalmanFilter>( state_, cov_ );
+      cov_ += process_noise;
+    }
     
     template< unsigned int __UpdateDim>
     void update( typename Update<__UpdateDim>::VectorType const & update,
 		 typename Update<__UpdateDim>::CovarianceType const & update_cov,
 		 typename Update<__UpdateDim>::TransitionType const & C )
     {
-      typename Update<__UpdateDim>::GainType gain = 
-      cov_*C.transpose() * (C*cov_*C.transpose() + update_cov).inverse();
-      
-      state_ = state_ + gain*( update - C*state_ );
-      cov_ = ( StateMatrix::Identity() - gain*C)*cov_;
+      __UpdatePolicy::template update<LinearKalmanFilter, __UpdateDim>( state_, cov_, update, update_cov, C );
     }
 
     /// In case you want to print the entire state 
@@ -0,0 +1,143 @@
+/***************************************************************************
+ *  include/object_tracking/kalman_update_benchmark_node.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_KALMANUPDATEBENCHMARK
+#define USCAUV_OBJECTTRACKING_KALMANUPDATEBENCHMARK
+
+// ROS
+#include <ros/ros.h>
+
+// uscauv
+#include <uscauv_common/base_node.h>
+#include <uscauv_common/param_loader.h>
+#include <uscauv_common/tic_toc.h>
+
+/// object tracking
+#include <object_tracking/kalman_filter.h>
+
+/// Eigen
+#include <Eigen/Eigenvalues>
+
+/**
+ * Times the measurement update policies of LinearKalmanFilter for the tracker's case
+ * (8 states, 4 measurements), and reports how far each one drifts from a symmetric
+ * positive definite covariance over a long run of predict/update cycles.
+ */
+class KalmanUpdateBenchmarkNode: public BaseNode
+{
+ private:
+  typedef uscauv::LinearKalmanFilter<8, double, uscauv::StandardKalmanUpdate> _StandardFilter;
+  typedef uscauv::LinearKalmanFilter<8, double, uscauv::JosephKalmanUpdate>   _JosephFilter;
+  typedef _StandardFilter::Control<8> _Control;
+  typedef _StandardFilter::Update<4>  _Update;
+
+  _StandardFilter::StateMatrix    state_transition_;
+  _Control::CovarianceType        control_cov_;
+  _Update::TransitionType         measurement_transition_;
+  _Update::CovarianceType         update_cov_;
+  
+ public:
+ KalmanUpdateBenchmarkNode(): BaseNode("KalmanUpdateBenchmark")
+    {
+    }
+
+ private:
+
+  // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
+  void spinFirst()
+  {
+    ros::NodeHandle nh_rel("~");
+
+    int const iterations = uscauv::param::load<int>( nh_rel, "iterations", 100000 );
+    double const dt = uscauv::param::load<double>( nh_rel, "dt", 1.0/60.0 );
+    double const control_variance = uscauv::param::load<double>( nh_rel, "control_variance", 1e-4 );
+    double const update_variance = uscauv::param::load<double>( nh_rel, "update_variance", 1e-6 );
+
+    /// same constant velocity model as the tracker
+    state_transition_ << 
+      Eigen::Matrix4d::Identity(), Eigen::Matrix4d::Identity() * dt,
+      Eigen::Matrix4d::Zero(),     Eigen::Matrix4d::Identity();
+    measurement_transition_ << Eigen::Matrix4d::Identity(), Eigen::Matrix4d::Zero();
+    control_cov_ = _Control::CovarianceType::Identity() * control_variance;
+    update_cov_ = _Update::CovarianceType::Identity() * update_variance;
+
+    /// the same measurements go to both filters
+    std::vector<_Update::VectorType> measurements( iterations );
+    for(int idx = 0; idx < iterations; ++idx )
+      measurements[ idx ] = _Update::VectorType::Random();
+    
+    runPolicy<_StandardFilter>( "standard", measurements );
+    runPolicy<_JosephFilter>( "joseph/ldlt", measurements );
+
+    ros::shutdown();
+  }  
+
+  // Running spin() will cause this function to get called at the loop rate until this node is killed.
+  void spinOnce()
+  {
+
+  }
+
+  template<class __Filter>
+  void runPolicy( std::string const & name, std::vector<_Update::VectorType> const & measurements )
+  {
+    __Filter filter( __Filter::StateVector::Zero(), __Filter::StateMatrix::Identity() );
+    double update_us = 0, max_asymmetry = 0;
+    
+    for(std::vector<_Update::VectorType>::const_iterator measurement_it = measurements.begin();
+	measurement_it != measurements.end(); ++measurement_it )
+      {
+	filter.template predict<8>( _Control::VectorType::Zero(), control_cov_, state_transition_ );
+	{
+	  tic;
+	  filter.template update<4>( *measurement_it, update_cov_, measurement_transition_ );
+	  update_us += toc( std::chrono::nanoseconds ) * 1e-3;
+	}
+	max_asymmetry = std::max( max_asymmetry, ( filter.cov_ - filter.cov_.transpose() ).cwiseAbs().maxCoeff() );
+      }
+
+    /// a covariance that has lost definiteness shows up as a non-positive eigenvalue
+    Eigen::SelfAdjointEigenSolver<typename __Filter::StateMatrix> eigen( 0.5*( filter.cov_ + filter.cov_.transpose() ) );
+    
+    ROS_INFO( "%12s | %8.3f us/update | max asymmetry: %10.3e | min eigenvalue: %10.3e | det: %10.3e",
+	      name.c_str(), update_us / measurements.size(), max_asymmetry, 
+	      eigen.eigenvalues().minCoeff(), filter.cov_.determinant() );
+  }
+};
+
+#endif // USCAUV_OBJECTTRACKING_KALMANUPDATEBENCHMARK
@@ -0,0 +1,115 @@
+/***************************************************************************
+ *  include/object_tracking/monocular_shape_measurement.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_MONOCULARSHAPEMEASUREMENT
+#define USCAUV_OBJECTTRACKING_MONOCULARSHAPEMEASUREMENT
+
+// ROS
+#include <image_geometry/pinhole_camera_model.h>
+
+/// uscauv
+#include <uscauv_common/simple_math.h>
+
+/// object tracking
+#include <object_tracking/nonlinear_kalman_filter.h>
+
+namespace uscauv
+{
+
+  /**
+   * Measurement model for a matched shape of known physical radius, for use with ExtendedKalmanFilter
+   * or UnscentedKalmanFilter. The state starts with the object's pose in the camera frame, [ x y z yaw ... ],
+   * and the measurement is what the shape matcher reports: [ u v radius_pixels theta ]. This is the inverse
+   * of reprojectObjectTo3d, so range from apparent size is fused by the filter instead of being
+   * inverted up front.
+   */
+  template<unsigned int __StateDim>
+  struct MonocularShapeMeasurement: public MeasurementModel<4>
+  {
+    typedef MeasurementModel<4>::VectorType VectorType;
+    typedef Eigen::Matrix<double, __StateDim, 1> StateVector;
+    typedef Eigen::Matrix<double, 4, __StateDim> TransitionType;
+
+    double fx_, fy_, cx_, cy_;
+    double radius_meters_;
+    /// the shape looks the same after rotating by this much
+    double symmetry_;
+
+  MonocularShapeMeasurement( image_geometry::PinholeCameraModel const & model, double const & radius_meters, 
+			     double const & symmetry = uscauv::TWO_PI ):
+    fx_( model.fx() ), fy_( model.fy() ), cx_( model.cx() ), cy_( model.cy() ),
+      radius_meters_( radius_meters ), symmetry_( symmetry ) {}
+
+    VectorType operator()( StateVector const & x ) const
+    {
+      VectorType z;
+      z << 
+	fx_ * x(0) / x(2) + cx_,
+	fy_ * x(1) / x(2) + cy_,
+	fx_ * radius_meters_ / x(2),
+	x(3);
+      return z;
+    }
+
+    TransitionType jacobian( StateVector const & x ) const
+    {
+      double const inv_z = 1.0 / x(2);
+      double const inv_z2 = inv_z * inv_z;
+      
+      TransitionType H = TransitionType::Zero();
+      H(0,0) = fx_ * inv_z;
+      H(0,2) = -fx_ * x(0) * inv_z2;
+      H(1,1) = fy_ * inv_z;
+      H(1,2) = -fy_ * x(1) * inv_z2;
+      H(2,2) = -fx_ * radius_meters_ * inv_z2;
+      H(3,3) = 1;
+      return H;
+    }
+
+    /// the angle wraps around at the shape's symmetry
+    VectorType residual( VectorType const & z, VectorType const & z_hat ) const
+    {
+      VectorType diff = z - z_hat;
+      diff(3) = uscauv::ring_difference<double>( z_hat(3), z(3), symmetry_ );
+      return diff;
+    }
+  };
+  
+}
+
+#endif // USCAUV_OBJECTTRACKING_MONOCULARSHAPEMEASUREMENT
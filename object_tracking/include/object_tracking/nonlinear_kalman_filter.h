@@ -0,0 +1,296 @@
+/***************************************************************************
+ *  include/object_tracking/nonlinear_kalman_filter.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_NONLINEARKALMANFILTER
+#define USCAUV_OBJECTTRACKING_NONLINEARKALMANFILTER
+
+/// object tracking
+#include <object_tracking/kalman_filter.h>
+
+/// Eigen
+#include <Eigen/Cholesky>
+
+#include <algorithm>
+
+namespace uscauv
+{
+
+  /**
+   * Base for measurement functors of dimension __UpdateDim. Functors provide
+   * 
+   *   VectorType operator()( StateVector const & x ) const              - predicted measurement h(x)
+   *   TransitionType jacobian( StateVector const & x ) const            - dh/dx, only needed by the EKF
+   *   VectorType residual( VectorType const & z, VectorType const & z_hat ) const 
+   * 
+   * residual() defaults to z - z_hat. Override it for angles.
+   */
+  template<unsigned int __UpdateDim, typename __NumericType = double>
+  struct MeasurementModel
+  {
+    typedef Eigen::Matrix<__NumericType, __UpdateDim, 1> VectorType;
+
+    VectorType residual( VectorType const & z, VectorType const & z_hat ) const
+    {
+      return z - z_hat;
+    }
+  };
+
+  /**
+   * Extended Kalman filter. Same dimension conventions as LinearKalmanFilter (Control<N>, Update<M>),
+   * and the linear predict/update are still available. Motion model functors provide
+   * 
+   *   StateVector operator()( StateVector const & x, Control<N>::VectorType const & u ) const
+   *   StateMatrix jacobian( StateVector const & x, Control<N>::VectorType const & u ) const
+   * 
+   * Updates use the LDLT/Joseph form of JosephKalmanUpdate.
+   */
+  template<unsigned int __StateDim, typename __NumericType = double>
+    class ExtendedKalmanFilter: public LinearKalmanFilter<__StateDim, __NumericType, JosephKalmanUpdate>
+    {
+    public:
+    typedef LinearKalmanFilter<__StateDim, __NumericType, JosephKalmanUpdate> _LinearFilter;
+    typedef typename _LinearFilter::StateVector StateVector;
+    typedef typename _LinearFilter::StateMatrix StateMatrix;
+
+    using _LinearFilter::predict;
+    using _LinearFilter::update;
+    
+    public:
+    ExtendedKalmanFilter( StateVector const & init_state, StateMatrix const & init_cov ):
+    _LinearFilter( init_state, init_cov ) {}
+
+    ExtendedKalmanFilter() {}
+    
+    /** 
+     * @param f Motion model functor
+     * @param control Control input
+     * @param process_noise Covariance added to the state covariance
+     */
+    template< unsigned int __ControlDim, class __MotionModel >
+    void predict( __MotionModel const & f,
+		  typename _LinearFilter::template Control<__ControlDim>::VectorType const & control,
+		  StateMatrix const & process_noise )
+    {
+      StateMatrix const F = f.jacobian( this->state_, control );
+      this->state_ = f( this->state_, control );
+      this->cov_ = F * this->cov_ * F.transpose() + process_noise;
+    }
+
+    /** 
+     * @param h Measurement model functor
+     * @param z Measurement
+     * @param update_cov Measurement covariance
+     */
+    template< unsigned int __UpdateDim, class __MeasurementModel >
+    void update( __MeasurementModel const & h,
+		 typename _LinearFilter::template Update<__UpdateDim>::VectorType const & z,
+		 typename _LinearFilter::template Update<__UpdateDim>::CovarianceType const & update_cov )
+    {
+      typename _LinearFilter::template Update<__UpdateDim>::TransitionType const H = h.jacobian( this->state_ );
+
+      JosephKalmanUpdate::correct<_LinearFilter, __UpdateDim>( this->state_, this->cov_, 
+							      h.residual( z, h( this->state_ ) ), 
+							      update_cov, H );
+    }
+    };
+
+  /**
+   * Unscented Kalman filter with the scaled sigma point set of Julier and Uhlmann (2N+1 points).
+   * Same functor interfaces as ExtendedKalmanFilter, but jacobians are never used. Sigma points
+   * and their images are fixed-size Eigen matrices, so nothing is allocated on the heap per update.
+   */
+  template<unsigned int __StateDim, typename __NumericType = double>
+    class UnscentedKalmanFilter: public LinearKalmanFilter<__StateDim, __NumericType, JosephKalmanUpdate>
+    {
+    public:
+    typedef LinearKalmanFilter<__StateDim, __NumericType, JosephKalmanUpdate> _LinearFilter;
+    typedef typename _LinearFilter::StateVector StateVector;
+    typedef typename _LinearFilter::StateMatrix StateMatrix;
+
+    static unsigned int const NumSigmaPoints = 2*__StateDim + 1;
+    
+    typedef Eigen::Matrix<__NumericType, __StateDim, NumSigmaPoints> SigmaMatrix;
+    typedef Eigen::Matrix<__NumericType, NumSigmaPoints, 1>          WeightVector;
+
+    using _LinearFilter::predict;
+    using _LinearFilter::update;
+
+    private:
+    /// weights for the mean and for the covariance
+    WeightVector mean_weights_, cov_weights_;
+    /// (N + lambda), scales the covariance before taking its square root
+    __NumericType spread_;
+    
+    public:
+    /** 
+     * @param alpha Spread of the sigma points around the mean, usually small (1e-3 to 1)
+     * @param beta Prior knowledge of the distribution, 2 is optimal for gaussians
+     * @param kappa Secondary scaling parameter, usually 0
+     */
+    UnscentedKalmanFilter( StateVector const & init_state, StateMatrix const & init_cov,
+			   __NumericType const & alpha = 1e-1, __NumericType const & beta = 2, 
+			   __NumericType const & kappa = 0 ):
+    _LinearFilter( init_state, init_cov )
+    {
+      setScaling( alpha, beta, kappa );
+    }
+
+    UnscentedKalmanFilter()
+    {
+      setScaling( 1e-1, 2, 0 );
+    }
+
+    void setScaling( __NumericType const & alpha, __NumericType const & beta, __NumericType const & kappa )
+    {
+      __NumericType const n = __StateDim;
+      __NumericType const lambda = alpha*alpha*( n + kappa ) - n;
+      spread_ = n + lambda;
+
+      mean_weights_.setConstant( 0.5 / spread_ );
+      cov_weights_.setConstant( 0.5 / spread_ );
+      mean_weights_(0) = lambda / spread_;
+      cov_weights_(0) = lambda / spread_ + ( 1 - alpha*alpha + beta );
+    }
+
+    /** 
+     * Sigma points of the current state distribution, one per column. If the covariance has lost
+     * positive definiteness to roundoff, the factorization is retried with a growing diagonal jitter.
+     * 
+     * @return False if no jitter made the covariance factorizable, in which case sigma is untouched
+     */
+    bool computeSigmaPoints( SigmaMatrix & sigma ) const
+    {
+      static unsigned int const max_attempts = 3;
+      
+      StateMatrix scaled_cov = spread_ * this->cov_;
+      __NumericType jitter = 1e-9 * std::max( __NumericType( scaled_cov.diagonal().cwiseAbs().maxCoeff() ), __NumericType( 1 ) );
+      
+      Eigen::LLT<StateMatrix> llt( scaled_cov );
+      for(unsigned int attempt = 0; llt.info() != Eigen::Success; ++attempt, jitter *= 1e3 )
+	{
+	  if( attempt == max_attempts )
+	    return false;
+	  
+	  scaled_cov.diagonal().array() += jitter;
+	  llt.compute( scaled_cov );
+	}
+      
+      StateMatrix const L = llt.matrixL();
+
+      sigma.col(0) = this->state_;
+      for(unsigned int idx = 0; idx < __StateDim; ++idx )
+	{
+	  sigma.col( 1 + idx ) = this->state_ + L.col( idx );
+	  sigma.col( 1 + __StateDim + idx ) = this->state_ - L.col( idx );
+	}
+      return true;
+    }
+    
+    /// @return False if the step was rejected because the covariance could not be factorized
+    template< unsigned int __ControlDim, class __MotionModel >
+    bool predict( __MotionModel const & f,
+		  typename _LinearFilter::template Control<__ControlDim>::VectorType const & control,
+		  StateMatrix const & process_noise )
+    {
+      SigmaMatrix sigma;
+      if( !computeSigmaPoints( sigma ) )
+	return false;
+
+      for(unsigned int idx = 0; idx < NumSigmaPoints; ++idx )
+	sigma.col( idx ) = f( StateVector( sigma.col( idx ) ), control );
+
+      this->state_ = sigma * mean_weights_;
+
+      StateMatrix cov = process_noise;
+      for(unsigned int idx = 0; idx < NumSigmaPoints; ++idx )
+	{
+	  StateVector const diff = sigma.col( idx ) - this->state_;
+	  cov += cov_weights_( idx ) * diff * diff.transpose();
+	}
+      this->cov_ = cov;
+      return true;
+    }
+
+    /// @return False if the step was rejected because the covariance could not be factorized
+    template< unsigned int __UpdateDim, class __MeasurementModel >
+    bool update( __MeasurementModel const & h,
+		 typename _LinearFilter::template Update<__UpdateDim>::VectorType const & z,
+		 typename _LinearFilter::template Update<__UpdateDim>::CovarianceType const & update_cov )
+    {
+      typedef typename _LinearFilter::template Update<__UpdateDim> _Update;
+      typedef Eigen::Matrix<__NumericType, __UpdateDim, NumSigmaPoints> _MeasurementSigmaMatrix;
+
+      SigmaMatrix sigma;
+      if( !computeSigmaPoints( sigma ) )
+	return false;
+
+      _MeasurementSigmaMatrix measurement_sigma;
+      for(unsigned int idx = 0; idx < NumSigmaPoints; ++idx )
+	measurement_sigma.col( idx ) = h( StateVector( sigma.col( idx ) ) );
+
+      /// residuals are taken against the central point, so that angles average correctly
+      typename _Update::VectorType const center = measurement_sigma.col(0);
+      typename _Update::VectorType mean_offset = _Update::VectorType::Zero();
+      for(unsigned int idx = 0; idx < NumSigmaPoints; ++idx )
+	mean_offset += mean_weights_( idx ) * h.residual( measurement_sigma.col( idx ), center );
+
+      typename _Update::VectorType const z_hat = center + mean_offset;
+
+      typename _Update::CovarianceType S = update_cov;
+      typename _Update::GainType cross_cov = _Update::GainType::Zero();
+      for(unsigned int idx = 0; idx < NumSigmaPoints; ++idx )
+	{
+	  typename _Update::VectorType const z_diff = h.residual( measurement_sigma.col( idx ), z_hat );
+	  StateVector const x_diff = sigma.col( idx ) - this->state_;
+	  S += cov_weights_( idx ) * z_diff * z_diff.transpose();
+	  cross_cov += cov_weights_( idx ) * x_diff * z_diff.transpose();
+	}
+
+      /// K = Pxz*S^-1  <=>  S*K^T = Pxz^T
+      typename _Update::GainType const gain = S.ldlt().solve( cross_cov.transpose() ).transpose();
+
+      this->state_ += gain * h.residual( z, z_hat );
+      StateMatrix const cov = this->cov_ - gain * S * gain.transpose();
+      this->cov_ = 0.5*( cov + cov.transpose() );
+      return true;
+    }
+    };
+  
+}
+
+#endif // USCAUV_OBJECTTRACKING_NONLINEARKALMANFILTER
@@ -0,0 +1,495 @@
+/***************************************************************************
+ *  include/object_tracking/tracker_replay_benchmark_node.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_OBJECTTRACKING_TRACKERREPLAYBENCHMARK
+#define USCAUV_OBJECTTRACKING_TRACKERREPLAYBENCHMARK
+
+// ROS
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+// uscauv
+#include <uscauv_common/param_loader.h>
+#include <uscauv_common/tic_toc.h>
+
+/// object tracking
+#include <object_tracking/unimodal_object_tracker_node.h>
+
+#include <algorithm>
+#include <random>
+
+/// How well one tracker held on to its object over a replay
+struct TrackContinuity
+{
+  /// messages after which the tracker had a best estimate
+  unsigned int tracked_;
+  /// times the best estimate disappeared after having been published
+  unsigned int dropouts_;
+  /// times the best estimate moved farther than the jump threshold between two messages
+  unsigned int jumps_;
+  unsigned int run_;
+  unsigned int longest_run_;
+  double filter_sum_;
+  unsigned int max_filters_;
+  bool have_last_;
+  tf::Vector3 last_position_;
+
+TrackContinuity(): tracked_(0), dropouts_(0), jumps_(0), run_(0), longest_run_(0),
+    filter_sum_(0), max_filters_(0), have_last_(false) {}
+};
+
+typedef std::map<std::string, TrackContinuity> _NamedContinuityMap;
+
+/// An object moving in front of the camera, in the camera's optical frame
+struct SyntheticObject
+{
+  std::string type_;
+  std::string shape_;
+  std::string color_;
+  double radius_;
+  Eigen::Vector3d position_;
+  Eigen::Vector3d velocity_;
+};
+
+/**
+ * Feeds a bag of MatchedShapeArray and CameraInfo messages through the tracker's callbacks as
+ * fast as possible, ticking the tracker after every matched shape message at that message's
+ * timestamp. Reports per-message latency, the number of live filters and the continuity of
+ * each tracker's best estimate. If generate is set, the bag is first written with synthetic
+ * objects and clutter, using the object definitions under model/objects.
+ */
+class TrackerReplayBenchmarkNode: public UnimodalObjectTrackerNode
+{
+ private:
+  typedef std::mt19937 _RandomEngine;
+
+  /// loop rate of the tracker being benchmarked, rather than this node's
+  double tracker_rate_;
+  
+ public:
+ TrackerReplayBenchmarkNode(): tracker_rate_( 0 )
+    {
+    }
+
+  double getTrackerRate()
+  {
+    return tracker_rate_;
+  }
+
+ private:
+
+  // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
+  void spinFirst()
+  {
+    /// object definitions and reconfigure servers are loaded the same way as in the tracker
+    UnimodalObjectTrackerNode::spinFirst();
+    
+    /// the replay calls the callbacks itself
+    matched_shape_sub_.shutdown();
+    camera_info_sub_.shutdown();
+    
+    std::string const log = uscauv::param::load<std::string>( nh_rel_, "log", "tracker_replay.bag" );
+    std::string const matched_shape_topic = 
+      uscauv::param::load<std::string>( nh_rel_, "matched_shape_topic", "/shape_matcher/matched_shapes" );
+    std::string const camera_info_topic = 
+      uscauv::param::load<std::string>( nh_rel_, "camera_info_topic", "/camera_info" );
+    double const jump_threshold = uscauv::param::load<double>( nh_rel_, "jump_threshold", 0.5 );
+    /// same default as unimodal_object_tracker.launch
+    tracker_rate_ = uscauv::param::load<double>( nh_rel_, "tracker_rate", 60.0 );
+
+    if( uscauv::param::load<bool>( nh_rel_, "generate", false ) )
+      {
+	if( !generateLog( log, matched_shape_topic, camera_info_topic ) )
+	  {
+	    ros::shutdown();
+	    return;
+	  }
+      }
+
+    replayLog( log, matched_shape_topic, camera_info_topic, jump_threshold );
+
+    ros::shutdown();
+  }  
+
+  // Running spin() will cause this function to get called at the loop rate until this node is killed.
+  void spinOnce()
+  {
+
+  }
+
+  /** 
+   * Run every message in the bag through the tracker and report the results.
+   * 
+   * @param path Bag to read
+   * @param matched_shape_topic Topic of the MatchedShapeArray messages in the bag
+   * @param camera_info_topic Topic of the CameraInfo messages in the bag
+   * @param jump_threshold Distance in meters that a best estimate can move between two messages
+   * before it counts as a jump
+   */
+  void replayLog( std::string const & path, std::string const & matched_shape_topic,
+		  std::string const & camera_info_topic, double const & jump_threshold )
+  {
+    rosbag::Bag bag;
+    try
+      {
+	bag.open( path, rosbag::bagmode::Read );
+      }
+    catch( rosbag::BagException & ex )
+      {
+	ROS_ERROR( "Caught exception [ %s ] opening log [ %s ].", ex.what(), path.c_str() );
+	return;
+      }
+
+    std::vector<std::string> topics;
+    topics.push_back( matched_shape_topic );
+    topics.push_back( camera_info_topic );
+    rosbag::View view( bag, rosbag::TopicQuery( topics ) );
+
+    std::vector<double> callback_us, tick_us, total_us;
+    _NamedContinuityMap continuity;
+    unsigned int skipped = 0;
+
+    /// there is no tf in the replay, so estimates are left in the camera frame
+    tf::Transform const observer_tf = tf::Transform::getIdentity();
+    
+    for( rosbag::View::iterator message_it = view.begin(); message_it != view.end(); ++message_it )
+      {
+	_CameraInfo::ConstPtr const camera_info = message_it->instantiate<_CameraInfo>();
+	if( camera_info )
+	  {
+	    cameraInfoCallback( camera_info );
+	    continue;
+	  }
+	
+	_MatchedShapeArray::ConstPtr const matched_shapes = message_it->instantiate<_MatchedShapeArray>();
+	if( !matched_shapes )
+	  continue;
+
+	if( !camera_model_.initialized() || 
+	    matched_shapes->header.frame_id != last_camera_info_.header.frame_id )
+	  {
+	    ++skipped;
+	    continue;
+	  }
+
+	/// tick right after the message, at its timestamp
+	ros::Time const stamp = matched_shapes->header.stamp.isZero() ? 
+	  message_it->getTime() : matched_shapes->header.stamp;
+	_TrackedObjectArrayMsg tracked_objects;
+	std::vector< tf::StampedTransform > object_transforms;
+	
+	{
+	  tic;
+	  matchedShapeCallback( matched_shapes );
+	  callback_us.push_back( toc( std::chrono::nanoseconds ) * 1e-3 );
+	}
+	{
+	  tic;
+	  updateEstimates( stamp, true, observer_tf, tracked_objects, object_transforms );
+	  tick_us.push_back( toc( std::chrono::nanoseconds ) * 1e-3 );
+	}
+	total_us.push_back( callback_us.back() + tick_us.back() );
+	
+	updateContinuity( tracked_objects, jump_threshold, continuity );
+      }
+    bag.close();
+
+    if( total_us.empty() )
+      {
+	ROS_WARN( "No matched shapes were replayed from [ %s ] ( %u skipped ).", path.c_str(), skipped );
+	return;
+      }
+
+    double total_sum = 0;
+    for( std::vector<double>::const_iterator us_it = total_us.begin(); us_it != total_us.end(); ++us_it )
+      total_sum += *us_it;
+    
+    ROS_INFO( "Replayed %zu messages ( %u skipped ) in %.3f s, %.1f messages/s.", 
+	      total_us.size(), skipped, total_sum * 1e-6, total_us.size() / ( total_sum * 1e-6 ) );
+    ROS_INFO( "%10s | %10s %10s %10s %10s (us)", "", "p50", "p90", "p99", "max" );
+    reportLatency( "callback", callback_us );
+    reportLatency( "tick", tick_us );
+    reportLatency( "total", total_us );
+    
+    for( _NamedContinuityMap::const_iterator continuity_it = continuity.begin(); 
+	 continuity_it != continuity.end(); ++continuity_it )
+      {
+	TrackContinuity const & track = continuity_it->second;
+	ROS_INFO( "%20s | filters: %6.2f mean, %3u max | tracked: %6.2f%% | longest run: %6u | dropouts: %4u | jumps: %4u",
+		  continuity_it->first.c_str(), track.filter_sum_ / total_us.size(), track.max_filters_,
+		  100.0 * track.tracked_ / total_us.size(), track.longest_run_, track.dropouts_, track.jumps_ );
+      }
+  }
+
+  /// Count every tracker's filters and follow its best estimate
+  void updateContinuity( _TrackedObjectArrayMsg const & tracked_objects, double const & jump_threshold,
+			 _NamedContinuityMap & continuity )
+  {
+    for( _NamedTrackerMap::const_iterator tracker_it = trackers_.begin(); tracker_it != trackers_.end();
+	 ++tracker_it )
+      {
+	TrackContinuity & track = continuity[ tracker_it->first ];
+	unsigned int const num_filters = tracker_it->second.filters_.size();
+	track.filter_sum_ += num_filters;
+	track.max_filters_ = std::max( track.max_filters_, num_filters );
+
+	std::vector<_TrackedObjectMsg>::const_iterator best_it = tracked_objects.objects.begin();
+	for( ; best_it != tracked_objects.objects.end(); ++best_it )
+	  {
+	    if( best_it->is_best_estimate && best_it->type == tracker_it->first )
+	      break;
+	  }
+
+	if( best_it == tracked_objects.objects.end() )
+	  {
+	    if( track.run_ )
+	      ++track.dropouts_;
+	    track.run_ = 0;
+	    track.have_last_ = false;
+	    continue;
+	  }
+
+	geometry_msgs::Point const & position = best_it->pose.pose.position;
+	tf::Vector3 const best_position( position.x, position.y, position.z );
+	
+	if( track.have_last_ && best_position.distance( track.last_position_ ) > jump_threshold )
+	  ++track.jumps_;
+	
+	++track.tracked_;
+	++track.run_;
+	track.longest_run_ = std::max( track.longest_run_, track.run_ );
+	track.last_position_ = best_position;
+	track.have_last_ = true;
+      }
+  }
+
+  static void reportLatency( std::string const & name, std::vector<double> samples )
+  {
+    std::sort( samples.begin(), samples.end() );
+    unsigned int const last = samples.size() - 1;
+    
+    ROS_INFO( "%10s | %10.2f %10.2f %10.2f %10.2f", name.c_str(), 
+	      samples[ last * 0.5 ], samples[ last * 0.9 ], samples[ last * 0.99 ], samples.back() );
+  }
+
+  /** 
+   * Write a bag of objects moving in front of a simulated camera, plus clutter. Each object is
+   * an instance of one of the loaded object definitions and is reported with its definition's
+   * shape and one of its colors. Clutter shapes look like real objects but are placed at random.
+   * 
+   * @return False if the bag could not be written
+   */
+  bool generateLog( std::string const & path, std::string const & matched_shape_topic,
+		    std::string const & camera_info_topic )
+  {
+    int const num_objects = uscauv::param::load<int>( nh_rel_, "num_objects", 4 );
+    /// mean number of false detections per frame
+    double const clutter = uscauv::param::load<double>( nh_rel_, "clutter", 2.0 );
+    double const miss_rate = uscauv::param::load<double>( nh_rel_, "miss_rate", 0.1 );
+    double const pixel_noise = uscauv::param::load<double>( nh_rel_, "pixel_noise", 1.0 );
+    double const duration = uscauv::param::load<double>( nh_rel_, "duration", 60.0 );
+    double const frame_rate = uscauv::param::load<double>( nh_rel_, "frame_rate", 30.0 );
+    int const seed = uscauv::param::load<int>( nh_rel_, "seed", 0 );
+
+    if( trackers_.empty() )
+      {
+	ROS_ERROR( "No objects are loaded. Can't generate a log." );
+	return false;
+      }
+
+    _CameraInfo const camera_info = syntheticCameraInfo( 640, 480, 500.0 );
+    double const focal = camera_info.K[0], cx = camera_info.K[2], cy = camera_info.K[5];
+
+    /// objects bounce around inside this box
+    Eigen::Vector3d const min_bound( -1.5, -1.0, 2.0 ), max_bound( 1.5, 1.0, 8.0 );
+    
+    _RandomEngine engine( seed );
+    std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+    std::normal_distribution<double> noise( 0.0, pixel_noise );
+    std::normal_distribution<double> theta_noise( 0.0, 0.05 );
+    std::poisson_distribution<int> clutter_count( std::max( clutter, 1e-9 ) );
+
+    /// object definitions to draw from, with their shapes
+    std::vector<SyntheticObject> definitions;
+    for( _ShapeTrackerMap::const_iterator shape_it = shape_tracker_map_.begin(); 
+	 shape_it != shape_tracker_map_.end(); ++shape_it )
+      {
+	ObjectTrackerStorage const & tracker = trackers_.at( shape_it->second );
+	if( tracker.colors_.empty() )
+	  continue;
+	
+	SyntheticObject definition;
+	definition.type_ = tracker.type_;
+	definition.shape_ = shape_it->first;
+	definition.radius_ = tracker.ideal_radius_;
+	definitions.push_back( definition );
+      }
+
+    if( definitions.empty() )
+      {
+	ROS_ERROR( "None of the loaded objects have colors. Can't generate a log." );
+	return false;
+      }
+    
+    std::vector<SyntheticObject> objects;
+    for( int idx = 0; idx < num_objects; ++idx )
+      {
+	SyntheticObject object = definitions[ idx % definitions.size() ];
+	object.color_ = randomColor( object.type_, engine );
+	for( int axis = 0; axis < 3; ++axis )
+	  {
+	    object.position_( axis ) = min_bound( axis ) + unit( engine ) * ( max_bound( axis ) - min_bound( axis ) );
+	    object.velocity_( axis ) = 0.5 * ( 2.0 * unit( engine ) - 1.0 );
+	  }
+	objects.push_back( object );
+      }
+
+    rosbag::Bag bag;
+    try
+      {
+	bag.open( path, rosbag::bagmode::Write );
+      }
+    catch( rosbag::BagException & ex )
+      {
+	ROS_ERROR( "Caught exception [ %s ] opening log [ %s ].", ex.what(), path.c_str() );
+	return false;
+      }
+
+    int const num_frames = duration * frame_rate;
+    double const dt = 1.0 / frame_rate;
+    /// bags can't hold messages at time zero
+    ros::Time const start( 1.0 );
+    _CameraInfo frame_camera_info = camera_info;
+    
+    for( int frame = 0; frame < num_frames; ++frame )
+      {
+	ros::Time const stamp = start + ros::Duration( frame * dt );
+	_MatchedShapeArray shapes;
+	shapes.header.stamp = stamp;
+	shapes.header.frame_id = camera_info.header.frame_id;
+	
+	for( std::vector<SyntheticObject>::iterator object_it = objects.begin(); object_it != objects.end(); 
+	     ++object_it )
+	  {
+	    object_it->position_ += object_it->velocity_ * dt;
+	    for( int axis = 0; axis < 3; ++axis )
+	      {
+		if( ( object_it->position_( axis ) < min_bound( axis ) && object_it->velocity_( axis ) < 0 ) ||
+		    ( object_it->position_( axis ) > max_bound( axis ) && object_it->velocity_( axis ) > 0 ) )
+		  object_it->velocity_( axis ) *= -1;
+	      }
+
+	    if( unit( engine ) < miss_rate )
+	      continue;
+	    
+	    Eigen::Vector3d const & position = object_it->position_;
+	    _MatchedShape shape;
+	    shape.x = focal * position.x() / position.z() + cx + noise( engine );
+	    shape.y = focal * position.y() / position.z() + cy + noise( engine );
+	    shape.scale = focal * object_it->radius_ / position.z() + noise( engine );
+	    shape.theta = theta_noise( engine );
+	    shape.type = object_it->shape_;
+	    shape.color = object_it->color_;
+
+	    if( shape.x < 0 || shape.x >= camera_info.width || shape.y < 0 || shape.y >= camera_info.height ||
+		shape.scale <= 0 )
+	      continue;
+	    
+	    shapes.shapes.push_back( shape );
+	  }
+
+	int const num_clutter = clutter > 0 ? clutter_count( engine ) : 0;
+	for( int idx = 0; idx < num_clutter; ++idx )
+	  {
+	    SyntheticObject const & definition = definitions[ int( unit( engine ) * definitions.size() ) % definitions.size() ];
+	    _MatchedShape shape;
+	    shape.x = unit( engine ) * camera_info.width;
+	    shape.y = unit( engine ) * camera_info.height;
+	    shape.scale = 5.0 + unit( engine ) * 75.0;
+	    shape.theta = theta_noise( engine );
+	    shape.type = definition.shape_;
+	    shape.color = randomColor( definition.type_, engine );
+	    shapes.shapes.push_back( shape );
+	  }
+
+	frame_camera_info.header.stamp = stamp;
+	bag.write( camera_info_topic, stamp, frame_camera_info );
+	bag.write( matched_shape_topic, stamp, shapes );
+      }
+    bag.close();
+
+    ROS_INFO( "Wrote %d frames with %d objects and %.2f clutter shapes per frame to [ %s ].",
+	      num_frames, num_objects, clutter, path.c_str() );
+    return true;
+  }
+
+  /// One of the colors that the object can have
+  std::string randomColor( std::string const & type, _RandomEngine & engine ) const
+  {
+    _ColorSet const & colors = trackers_.at( type ).colors_;
+    std::uniform_int_distribution<int> pick( 0, colors.size() - 1 );
+    _ColorSet::const_iterator color_it = colors.begin();
+    std::advance( color_it, pick( engine ) );
+    return *color_it;
+  }
+
+  /// Undistorted camera with the principal point at the center of the image
+  static _CameraInfo syntheticCameraInfo( unsigned int const & width, unsigned int const & height,
+					  double const & focal )
+  {
+    _CameraInfo camera_info;
+    camera_info.header.frame_id = "synthetic_camera";
+    camera_info.width = width;
+    camera_info.height = height;
+    camera_info.distortion_model = "plumb_bob";
+    camera_info.D.assign( 5, 0.0 );
+
+    double const cx = 0.5 * width, cy = 0.5 * height;
+    double const K[9] = { focal, 0, cx,   0, focal, cy,   0, 0, 1 };
+    double const R[9] = { 1, 0, 0,   0, 1, 0,   0, 0, 1 };
+    double const P[12] = { focal, 0, cx, 0,   0, focal, cy, 0,   0, 0, 1, 0 };
+    std::copy( K, K + 9, camera_info.K.begin() );
+    std::copy( R, R + 9, camera_info.R.begin() );
+    std::copy( P, P + 12, camera_info.P.begin() );
+
+    return camera_info;
+  }
+};
+
+#endif // USCAUV_OBJECTTRACKING_TRACKERREPLAYBENCHMARK
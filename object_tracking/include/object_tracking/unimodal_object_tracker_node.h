@@ -61,14 +61,20 @@
 #include <auv_msgs/TrackedObjectArray.h>
 
 #include <cmath>
+#include <limits>
+#include <deque>
+#include <algorithm>
 #include <map>
 #include <unordered_set>
 
 /// linalg
 #include <Eigen/LU>
+#include <Eigen/Cholesky>
 
 /// object tracking
 #include <object_tracking/kalman_filter.h>
+#include <object_tracking/kalman_bank.h>
+#include <object_tracking/assignment.h>
 #include <object_tracking/TrackedObjectConfig.h>
 #include <object_tracking/ObjectTrackerConfig.h>
 
@@ -91,35 +97,198 @@ typedef object_tracking::TrackedObjectConfig _TrackedObjectConfig;
 typedef object_tracking::ObjectTrackerConfig _ObjectTrackerConfig;
 
 /// template arguments are dims for state/update/control vectors
-typedef uscauv::LinearKalmanFilter<8>   _ObjectKalmanFilter;
+typedef uscauv::KalmanBank<8, double, uscauv::JosephKalmanUpdate> _ObjectKalmanBank;
+typedef _ObjectKalmanBank::FilterType _ObjectKalmanFilter;
 typedef _ObjectKalmanFilter::Control<8> _FullStateControl;
 typedef _ObjectKalmanFilter::Update<4>  _PositionUpdate;
 
 /// For using estimates from optical flow - not implemented yet
 typedef _ObjectKalmanFilter::Update<2>  _FlowVelocityUpdate;
 
+/// [ x y z yaw ] positions followed by their velocities
+typedef uscauv::ConstantVelocityModel<4> _ObjectMotionModel;
+
 typedef std::unordered_set<std::string> _ColorSet;
 
-/// TODO: Sort filters_ based on uncertainty
+/**
+ * Projected position distribution N( H*x, H*P*H^T ) of a filter, factored once so that
+ * it can be evaluated against every measurement in a frame. Must be invalidated whenever
+ * the filter is predicted or updated.
+ */
+struct PositionLikelihood
+{
+  _PositionUpdate::VectorType mean_;
+  Eigen::LLT<_PositionUpdate::CovarianceType> llt_;
+  /// log of the gaussian normalization term, -0.5*( k*log(2pi) + log|cov| )
+  double log_normalizer_;
+  bool ready_;
+  /// false if the projected covariance is not positive definite
+  bool valid_;
+
+PositionLikelihood(): log_normalizer_(0), ready_(false), valid_(false) {}
+
+  void invalidate()
+  {
+    ready_ = false;
+  }
+
+  /// state and cov can be a filter's members or views into a KalmanBank
+  template<class __State, class __Cov>
+  void compute( __State const & state, __Cov const & cov, _PositionUpdate::TransitionType const & H )
+  {
+    mean_ = H * state;
+    llt_.compute( H * cov * H.transpose() );
+    valid_ = ( llt_.info() == Eigen::Success );
+
+    if( valid_ )
+      {
+	/// log|cov| = 2 * sum( log( diag( L ) ) )
+	double const log_det = 2.0 * llt_.matrixLLT().diagonal().array().log().sum();
+	log_normalizer_ = -0.5 * ( _PositionUpdate::VectorType::RowsAtCompileTime * log( uscauv::TWO_PI ) + log_det );
+      }
+    ready_ = true;
+  }
+  
+  /** 
+   * Gaussian log-likelihood, but we take the modulus of term 4 because it's a rotation.
+   * We include the determinant because we want to compare probabilities for
+   * different filters with different covariances.
+   */
+  double logPDF( _PositionUpdate::VectorType const & x, double const & yaw_symmetry ) const
+  {
+    if( !valid_ )
+      return -std::numeric_limits<double>::infinity();
+    
+    _PositionUpdate::VectorType diff_term = x - mean_;
+    diff_term(3) = uscauv::ring_distance<double>( diff_term(3), 0, yaw_symmetry );
 
+    /// squared mahalanobis distance, |L^-1 * diff|^2
+    double const md = llt_.matrixL().solve( diff_term ).squaredNorm();
+
+    return log_normalizer_ - 0.5*md;
+  }
+};
+
+/// Bookkeeping for one filter. The filter itself lives in a KalmanBank, at the same index.
 struct FilterStorage
 {
-  _ObjectKalmanFilter filter_;
   std::string color_;
+  PositionLikelihood likelihood_;
+  /// determinant of the state covariance, refreshed whenever the filter is predicted or updated
+  double det_;
+  /// determinant of the filter extrapolated to the time of the last tick
+  double estimate_det_;
+  /// identifies the hypothesis in the tracker's history, so that killing it also removes it there
+  unsigned int id_;
 };
 
-typedef std::vector<FilterStorage> _KalmanFilterVector;
+typedef std::vector<FilterStorage> _FilterStorageVector;
+
+/// A tracker's hypotheses, stored as a bank of filters and their bookkeeping at the same indices
+struct FilterPool
+{
+  _ObjectKalmanBank filters_;
+  _FilterStorageVector storage_;
+
+  unsigned int size() const { return storage_.size(); }
+  bool empty() const { return storage_.empty(); }
+
+  void reserve( unsigned int const & capacity )
+  {
+    filters_.reserve( capacity );
+    storage_.reserve( capacity );
+  }
+
+  void push_back( _ObjectKalmanFilter const & filter, FilterStorage const & storage )
+  {
+    filters_.push_back( filter );
+    storage_.push_back( storage );
+  }
+
+  void set( unsigned int const & idx, _ObjectKalmanFilter const & filter, FilterStorage const & storage )
+  {
+    filters_.set( idx, filter );
+    storage_[ idx ] = storage;
+  }
+
+  void move( unsigned int const & src, unsigned int const & dst )
+  {
+    filters_.move( src, dst );
+    storage_[ dst ] = storage_[ src ];
+  }
+
+  /// Drop the filters from index size onwards
+  void resize( unsigned int const & size )
+  {
+    filters_.resize( size );
+    storage_.resize( size );
+  }
+
+  /// Remove the filters with any of the given ids, keeping the rest in order
+  void remove( std::vector<unsigned int> const & ids )
+  {
+    unsigned int keep_idx = 0;
+    for(unsigned int idx = 0; idx < size(); ++idx )
+      {
+	if( std::find( ids.begin(), ids.end(), storage_[ idx ].id_ ) != ids.end() )
+	  continue;
+
+	if( keep_idx != idx )
+	  move( idx, keep_idx );
+	++keep_idx;
+      }
+    resize( keep_idx );
+  }
+};
+
+/// A matched shape reprojected into a tracker's measurement space
+struct TrackerMeasurement
+{
+  _PositionUpdate::VectorType mean_;
+  std::string color_;
+};
+
+typedef std::map<std::string, std::vector<TrackerMeasurement> > _NamedMeasurementMap;
+
+/// A tracker's filters right after the measurements stamped at stamp_ were applied
+struct TrackerSnapshot
+{
+  ros::Time stamp_;
+  std::vector<TrackerMeasurement> measurements_;
+  FilterPool filters_;
+};
+
+/// Ordered by stamp, oldest first
+typedef std::deque<TrackerSnapshot> _TrackerHistory;
+
+/// Entry of the association cost matrix for a measurement (row) and filter (col) that passed gating
+struct GatedPair
+{
+  int row_;
+  int col_;
+  double cost_;
+};
 
 struct ObjectTrackerStorage
 {
-  std::vector<FilterStorage> filters_;
+  /// pool of hypotheses, never grows past config_.max_hypotheses
+  FilterPool filters_;
+  /// filters_ extrapolated to the time of the last tick, which is what gets published
+  _ObjectKalmanBank estimates_;
   double ideal_radius_;
   
   std::string type_;
   _ColorSet colors_;
   
+  /// time that filters_ has been predicted to, i.e. the stamp of the latest measurement
   ros::Time last_predict_time_;
+  /// recent measurements, so that late ones can be applied by replaying from a snapshot
+  _TrackerHistory history_;
   _TrackedObjectConfig config_;
+  /// id of the next filter to be spawned
+  unsigned int next_filter_id_;
+
+ObjectTrackerStorage(): next_filter_id_( 0 ) {}
 };
 
 
@@ -129,30 +298,10 @@ typedef std::pair<_ShapeTrackerMap::iterator, _ShapeTrackerMap::iterator> _Shape
 
 typedef std::map<std::string, ObjectTrackerStorage> _NamedTrackerMap;
 
-/** 
- * Gaussian pdf, but we take the modulus of term 4 because it's a rotatation.
- * We include the determinant because we want to compare probabilities for
- * different filters with different covariances. The 2pi term is unneccessary
- */
-static double getGaussianPDFPosition(_PositionUpdate::VectorType x,
-				     _PositionUpdate::VectorType mean, 
-				     _PositionUpdate::CovarianceType cov,
-				     double const & yaw_symmetry )
-{
-  _PositionUpdate::VectorType diff_term = x - mean;
-  diff_term(3) = uscauv::ring_distance<double>( diff_term(3), 0, yaw_symmetry );
-
-  /// mahalanobis distance
-  double const md = diff_term.transpose() * cov.inverse() * diff_term;
-  double const det = Eigen::PartialPivLU<_PositionUpdate::CovarianceType>(cov).determinant();
-  
-  return exp(-0.5*md) / sqrt( pow(uscauv::TWO_PI, 4)*det );
-}
-
 /// TODO: Add support for start/stop/reset tracking service
 class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 {
- private:
+ protected:
   /// ros
   ros::NodeHandle nh_rel_;
   ros::Subscriber matched_shape_sub_, camera_info_sub_;
@@ -187,8 +336,10 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
     }
 
   /** 
-   * For each matched shape corresponding to a tracked object, reproject to 3d and use
-   * as a measurement update for the object's kalman filter
+   * For each matched shape corresponding to a tracked object, reproject to 3d. Then, for each tracker,
+   * predict the filters to the message's timestamp and associate all of the message's measurements 
+   * with them at once (global nearest neighbor), use them as measurement updates and spawn filters
+   * for the measurements that were left over.
    * 
    * @param msg WHat it is
    */
@@ -200,17 +351,39 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	return;
       }
 
+    if( !camera_model_.initialized() )
+      {
+	ROS_WARN( "Camera model is not ready.");
+	return;
+      }
+
+    if( depth_method_ != "monocular" )
+      {
+	ROS_ERROR("Bad depth method.");
+	return;
+      }
+
+    /// Only shapes that a tracker accepts get reprojected. Each one is reprojected once at unit size,
+    /// and every tracker scales it by the size of its object.
+    std::vector<bool> accepted( msg->shapes.size(), false );
+    for( unsigned int shape_idx = 0; shape_idx < msg->shapes.size(); ++shape_idx )
+      accepted[ shape_idx ] = isShapeTracked( msg->shapes[ shape_idx ] );
+
+    std::vector<tf::Vector3> unit_reprojections;
+    uscauv::reprojectObjectTo3d( camera_model_, *msg, 1.0, unit_reprojections, &accepted );
+    
+    /// measurements grouped by the tracker that they belong to
+    _NamedMeasurementMap tracker_measurements;
         
-    for( std::vector<_MatchedShape>::const_iterator shape_it= msg->shapes.begin();
-	 shape_it != msg->shapes.end(); ++shape_it)
+    for( unsigned int shape_idx = 0; shape_idx < msg->shapes.size(); ++shape_idx )
       {
+	if( !accepted[ shape_idx ] ) continue;
 
+	_MatchedShape const * const shape_it = &msg->shapes[ shape_idx ];
+	
 	/// Find all of the trackers that are tracking objects with this shape
 	_ShapeTrackerMapRange match_range = shape_tracker_map_.equal_range( shape_it->type );
 
-	if( match_range.first == match_range.second ) continue;
-
-
 	/// Process the measurement for each compatible tracker
 	for( _ShapeTrackerMap::iterator tracker_it = match_range.first; tracker_it != match_range.second;
 	     ++tracker_it )
@@ -231,88 +404,347 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	    if( storage.colors_.find( shape_it->color ) == storage.colors_.end() )
 	      continue;
 	    
-	    tf::Vector3 camera_to_object_vec;	
-
-	    if( !camera_model_.initialized() )
-	      {
-		ROS_WARN( "Camera model is not ready.");
-		return;
-	      }
-
-	    if( depth_method_ == "monocular" )
-	      {
-		camera_to_object_vec = 
-		  uscauv::reprojectObjectTo3d( camera_model_, cv::Point2d( shape_it->x, shape_it->y),
-					       shape_it->scale, storage.ideal_radius_ );
-	      }
-	    else
-	      {
-		ROS_ERROR("Bad depth method.");
-		return;
-	      }
+	    tf::Vector3 const camera_to_object_vec = unit_reprojections[ shape_idx ] * storage.ideal_radius_;
 	
-	    // ################################################################
-	    // Update filter ##################################################
-	    // ################################################################
-
-	    /// Get measurement update params, then update
-	    _PositionUpdate::VectorType update_mean;
-	    update_mean << 
+	    /// Get measurement update params
+	    TrackerMeasurement measurement;
+	    measurement.mean_ << 
 	      camera_to_object_vec.x(),
 	      camera_to_object_vec.y(), 
 	      camera_to_object_vec.z(),
 	      shape_it->theta;
+	    measurement.color_ = shape_it->color;
 
-	    int idx = 0;
-	    int max_idx = -1;
-	    double max_prob = 0;
-	    _KalmanFilterVector & filters = storage.filters_;
-	    int neighbors = 0;
-	    for(_KalmanFilterVector::iterator filter_it = filters.begin(); filter_it != filters.end();
-		++filter_it, ++idx )
-	      {
-		_ObjectKalmanFilter & filter = filter_it->filter_;
-		
-		_PositionUpdate::VectorType state_pos = measurement_transition_*filter.state_;
-		_PositionUpdate::VectorType diff_term = state_pos - update_mean;
+	    tracker_measurements[ tracker->first ].push_back( measurement );
+	    
+	  } // matched trackers
+      } // matched shapes
+
+    // ################################################################
+    // Update filters #################################################
+    // ################################################################
 
-		double const d = getGaussianPDFPosition( update_mean, state_pos, measurement_transition_ * filter.cov_ * measurement_transition_.transpose(), storage.config_.symmetry );
-		double const dist_euclidian = diff_term.block(0,0,3,1).norm();
-		double const dist_angular = uscauv::ring_distance<double>( diff_term(3), 0, storage.config_.symmetry );
-		ROS_DEBUG("PDF val: %0.20f, dist: %f, angle %f", d, dist_euclidian, dist_angular);
+    /// Some publishers don't stamp their messages
+    ros::Time const stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
 
-		if( dist_euclidian <= storage.config_.exclude_distance
-		    && dist_angular <= storage.config_.exclude_angle
-		    && d > max_prob )
-		  {
-		    max_prob = d;
-		    max_idx = idx;
-		    neighbors++;
-		  }	    
-	      }
-	    ROS_DEBUG("Found %d neighbor filters.", neighbors);
-	    /// Spawn a new filter if none of the current filters are a good match for the measurement
-	    if( max_idx == -1 )
-	      {
-		_ObjectKalmanFilter::StateVector initial_state = measurement_transition_.transpose() * update_mean;
+    for( _NamedMeasurementMap::const_iterator measurement_it = tracker_measurements.begin();
+	 measurement_it != tracker_measurements.end(); ++measurement_it )
+      {
+	applyMeasurements( trackers_.at( measurement_it->first ), stamp, measurement_it->second );
+      }
+  } //callback
+
+  /// True if any tracker follows objects with the shape's type and color
+  bool isShapeTracked( _MatchedShape const & shape ) const
+  {
+    _ShapeTrackerMap::const_iterator tracker_it = shape_tracker_map_.lower_bound( shape.type );
+    for( ; tracker_it != shape_tracker_map_.end() && tracker_it->first == shape.type; ++tracker_it )
+      {
+	_NamedTrackerMap::const_iterator const tracker = trackers_.find( tracker_it->second );
+	if( tracker != trackers_.end() && tracker->second.colors_.count( shape.color ) )
+	  return true;
+      }
+    return false;
+  }
+
+  /** 
+   * Predict the tracker's filters to the measurements' timestamp and apply them. Measurements
+   * that are older than the latest one applied are inserted into the tracker's history instead,
+   * and every measurement after them is re-applied starting from the snapshot just before them.
+   * Measurements older than the whole history are dropped.
+   * 
+   * @param storage Tracker to update
+   * @param stamp Time at which the measurements were taken
+   * @param measurements All of this message's measurements for the tracker
+   */
+  void applyMeasurements( ObjectTrackerStorage & storage, ros::Time const & stamp, 
+			  std::vector<TrackerMeasurement> const & measurements )
+  {
+    _TrackerHistory & history = storage.history_;
+    
+    TrackerSnapshot snapshot;
+    snapshot.stamp_ = stamp;
+    snapshot.measurements_ = measurements;
+
+    if( history.empty() || stamp >= storage.last_predict_time_ )
+      {
+	predictFilters( storage, stamp );
+	associateMeasurements( storage, measurements );
+
+	snapshot.filters_ = storage.filters_;
+	history.push_back( snapshot );
+      }
+    else
+      {
+	/// first snapshot that is newer than the measurement
+	_TrackerHistory::iterator replay_it = history.end();
+	while( replay_it != history.begin() && (replay_it - 1)->stamp_ > stamp )
+	  --replay_it;
+
+	if( replay_it == history.begin() )
+	  {
+	    ROS_DEBUG("Dropped measurement %.3f s older than the tracker history [ %s ].",
+		      ( history.front().stamp_ - stamp ).toSec(), storage.type_.c_str() );
+	    return;
+	  }
+	
+	ROS_DEBUG("Replaying %d snapshots for late measurement [ %s ].", 
+		  int( history.end() - replay_it ), storage.type_.c_str() );
+
+	/// restore the snapshot before the measurement, then re-apply everything after it
+	storage.filters_ = (replay_it - 1)->filters_;
+	storage.last_predict_time_ = (replay_it - 1)->stamp_;
+	replay_it = history.insert( replay_it, snapshot );
+
+	for(; replay_it != history.end(); ++replay_it )
+	  {
+	    predictFilters( storage, replay_it->stamp_ );
+	    associateMeasurements( storage, replay_it->measurements_ );
+	    replay_it->filters_ = storage.filters_;
+	  }
+      }
+
+    /// keep one snapshot at least history_length older than the latest one to replay from
+    ros::Time const history_start = history.back().stamp_ - ros::Duration( config_.history_length );
+    while( history.size() > 1 && history[1].stamp_ <= history_start )
+      history.pop_front();
+  }
+
+  /// predict_variance is the variance added over one loop period, so scale it to the prediction interval
+  _FullStateControl::CovarianceType processNoise( double const & dt )
+  {
+    return control_cov_ * ( dt * getTrackerRate() );
+  }
+
+  /// Rate of the tracker's loop, which predict_variance is defined against
+  virtual double getTrackerRate()
+  {
+    return getLoopRate();
+  }
 
-		FilterStorage new_filter;
-		new_filter.filter_ = _ObjectKalmanFilter( initial_state, initial_cov_ );
-		new_filter.color_ = shape_it->color;
+  /// Predict all of the tracker's filters forward to the given time
+  void predictFilters( ObjectTrackerStorage & storage, ros::Time const & stamp )
+  {
+    double const dt = ( stamp - storage.last_predict_time_ ).toSec();
+    storage.last_predict_time_ = stamp;
+
+    if( dt <= 0 || storage.filters_.empty() )
+      return;
+
+    FilterPool & pool = storage.filters_;
+    
+    /// no control input
+    pool.filters_.predict( _ObjectMotionModel( dt ), processNoise( dt ) );
+
+    for(unsigned int idx = 0; idx < pool.size(); ++idx )
+      {
+	pool.storage_[ idx ].likelihood_.invalidate();
+	pool.storage_[ idx ].det_ = covarianceDeterminant( pool.filters_.cov( idx ) );
+      }
+  }
 
-		storage.filters_.push_back( new_filter );
-		ROS_DEBUG_STREAM("Spawned filter ( " << initial_state.transpose() << " ).");
+  /** 
+   * Global nearest neighbor association. Builds the cost matrix of negative log-likelihoods
+   * between every measurement and every filter that it is gated with, solves it with the
+   * Hungarian algorithm, updates the assigned filters and spawns a new filter for every
+   * measurement that was not assigned. Rows and columns without any gated entries never enter
+   * the solver, so its size only depends on the measurements and filters that are actually
+   * close to each other.
+   * 
+   * @param storage Tracker to update
+   * @param measurements All of this message's measurements for the tracker
+   */
+  void associateMeasurements( ObjectTrackerStorage & storage, std::vector<TrackerMeasurement> const & measurements )
+  {
+    FilterPool & pool = storage.filters_;
+    int const num_measurements = measurements.size();
+    int const num_filters = pool.size();
+
+    /// gated pairs, and compact indices of the rows/cols they use
+    std::vector<GatedPair> gated;
+    std::vector<int> measurement_row( num_measurements, -1 ), filter_col( num_filters, -1 );
+    std::vector<int> row_measurement, col_filter;
+    
+    for(int filter_idx = 0; filter_idx < num_filters; ++filter_idx )
+      {
+	/// the factorization is shared by all measurements until this filter changes
+	PositionLikelihood & likelihood = pool.storage_[ filter_idx ].likelihood_;
+	if( !likelihood.ready_ )
+	  likelihood.compute( pool.filters_.state( filter_idx ), pool.filters_.cov( filter_idx ), 
+			      measurement_transition_ );
+	
+	for(int measurement_idx = 0; measurement_idx < num_measurements; ++measurement_idx )
+	  {
+	    _PositionUpdate::VectorType const & update_mean = measurements[ measurement_idx ].mean_;
+	    _PositionUpdate::VectorType const diff_term = likelihood.mean_ - update_mean;
+
+	    double const dist_euclidian = diff_term.block(0,0,3,1).norm();
+	    double const dist_angular = uscauv::ring_distance<double>( diff_term(3), 0, storage.config_.symmetry );
+
+	    if( dist_euclidian > storage.config_.exclude_distance
+		|| dist_angular > storage.config_.exclude_angle )
+	      continue;
+
+	    /// compare log-likelihoods, since the pdf itself underflows for far away filters
+	    double const log_prob = likelihood.logPDF( update_mean, storage.config_.symmetry );
+	    ROS_DEBUG("Log PDF val: %f, dist: %f, angle %f", log_prob, dist_euclidian, dist_angular);
+
+	    if( !std::isfinite( log_prob ) )
+	      continue;
+
+	    if( measurement_row[ measurement_idx ] < 0 )
+	      {
+		measurement_row[ measurement_idx ] = row_measurement.size();
+		row_measurement.push_back( measurement_idx );
 	      }
-	    else
+	    if( filter_col[ filter_idx ] < 0 )
 	      {
-		FilterStorage & updated_filter = storage.filters_.at(max_idx);
-		updated_filter.filter_.update<4>( update_mean, update_cov_, measurement_transition_ );
-		updated_filter.color_ = shape_it->color;
+		filter_col[ filter_idx ] = col_filter.size();
+		col_filter.push_back( filter_idx );
 	      }
-	    
-	  } // matched trackers
-      } // matched shapes
-  } //callback
+	    GatedPair const pair = { measurement_row[ measurement_idx ], filter_col[ filter_idx ], -log_prob };
+	    gated.push_back( pair );
+	  }
+      }
+
+    /// Solve the association over gated pairs only. Pairs outside of the gate get a cost that
+    /// no combination of gated pairs can reach, and are dropped if the solver has to use them.
+    std::vector<int> row_assignment;
+    std::vector<bool> is_gated;
+    if( gated.size() )
+      {
+	double max_cost = 0;
+	for(std::vector<GatedPair>::const_iterator gated_it = gated.begin(); gated_it != gated.end(); ++gated_it )
+	  max_cost = std::max( max_cost, std::abs( gated_it->cost_ ) );
+	double const infeasible_cost = ( max_cost + 1.0 ) * ( row_measurement.size() + col_filter.size() + 1 );
+	
+	Eigen::MatrixXd cost = Eigen::MatrixXd::Constant( row_measurement.size(), col_filter.size(), infeasible_cost );
+	is_gated.assign( row_measurement.size() * col_filter.size(), false );
+	for(std::vector<GatedPair>::const_iterator gated_it = gated.begin(); gated_it != gated.end(); ++gated_it )
+	  {
+	    cost( gated_it->row_, gated_it->col_ ) = gated_it->cost_;
+	    is_gated[ gated_it->row_ * col_filter.size() + gated_it->col_ ] = true;
+	  }
+	
+	uscauv::solveAssignment( cost, row_assignment );
+      }
+
+    std::vector<bool> assigned( num_measurements, false );
+    for(unsigned int row = 0; row < row_assignment.size(); ++row )
+      {
+	int const col = row_assignment[ row ];
+	if( col < 0 || !is_gated[ row * col_filter.size() + col ] )
+	  continue;
+
+	TrackerMeasurement const & measurement = measurements[ row_measurement[ row ] ];
+	int const filter_idx = col_filter[ col ];
+	pool.filters_.update<4>( filter_idx, measurement.mean_, update_cov_, measurement_transition_ );
+	
+	FilterStorage & updated_filter = pool.storage_[ filter_idx ];
+	updated_filter.likelihood_.invalidate();
+	updated_filter.det_ = covarianceDeterminant( pool.filters_.cov( filter_idx ) );
+	updated_filter.color_ = measurement.color_;
+	assigned[ row_measurement[ row ] ] = true;
+      }
+    ROS_DEBUG("Associated %d measurements with %d filters, %d gated pairs.", 
+	      num_measurements, num_filters, int( gated.size() ) );
+
+    /// Spawn a new filter for each measurement that none of the current filters are a good match for
+    for(int measurement_idx = 0; measurement_idx < num_measurements; ++measurement_idx )
+      {
+	if( assigned[ measurement_idx ] )
+	  continue;
+	
+	TrackerMeasurement const & measurement = measurements[ measurement_idx ];
+	_ObjectKalmanFilter::StateVector initial_state = measurement_transition_.transpose() * measurement.mean_;
+
+	_ObjectKalmanFilter const new_filter( initial_state, initial_cov_ );
+	FilterStorage new_storage;
+	new_storage.color_ = measurement.color_;
+	new_storage.det_ = covarianceDeterminant( new_filter.cov_ );
+
+	spawnFilter( storage, new_filter, new_storage );
+      }
+  }
+
+  static double covarianceDeterminant( _ObjectKalmanFilter::StateMatrix const & cov )
+  {
+    return Eigen::PartialPivLU<_ObjectKalmanFilter::StateMatrix>( cov ).determinant();
+  }
+
+  /// Index of the filter with the largest covariance determinant, or -1 if there are no filters
+  static int leastCertainFilter( _FilterStorageVector const & filters )
+  {
+    int max_idx = -1;
+    for(unsigned int idx = 0; idx < filters.size(); ++idx )
+      {
+	if( max_idx < 0 || filters[ idx ].det_ > filters[ max_idx ].det_ )
+	  max_idx = idx;
+      }
+    return max_idx;
+  }
+
+  /** 
+   * Evict the least certain filters until the pool fits
+   * 
+   * @param pool Pool to shrink
+   * @param capacity Number of filters to keep
+   * @param evicted_ids The ids of the evicted filters are appended to this
+   */
+  static void truncatePool( FilterPool & pool, unsigned int const & capacity,
+			    std::vector<unsigned int> & evicted_ids )
+  {
+    while( pool.size() > capacity )
+      {
+	int const evict_idx = leastCertainFilter( pool.storage_ );
+	evicted_ids.push_back( pool.storage_[ evict_idx ].id_ );
+	pool.move( pool.size() - 1, evict_idx );
+	pool.resize( pool.size() - 1 );
+      }
+  }
+
+  /** 
+   * Add a filter to the tracker's pool. If the pool is full, the new filter replaces the least
+   * certain one, but only if it is more certain itself. A new filter starts at the initial
+   * covariance, so a burst of false positives only recycles hypotheses that are no more certain
+   * than a fresh one, and established tracks stay.
+   * 
+   * @param storage Tracker to add the filter to
+   * @param new_filter Filter to add
+   * @param spawn_storage Bookkeeping for the new filter. Its det_ must be set, id_ is assigned here.
+   */
+  void spawnFilter( ObjectTrackerStorage & storage, _ObjectKalmanFilter const & new_filter, 
+		    FilterStorage const & spawn_storage )
+  {
+    FilterPool & pool = storage.filters_;
+    FilterStorage new_storage = spawn_storage;
+    new_storage.id_ = storage.next_filter_id_++;
+    unsigned int const capacity = storage.config_.max_hypotheses;
+    
+    if( pool.size() < capacity )
+      {
+	pool.push_back( new_filter, new_storage );
+	ROS_DEBUG_STREAM("Spawned filter ( " << new_filter.state_.transpose() << " ).");
+	return;
+      }
+
+    int const evict_idx = leastCertainFilter( pool.storage_ );
+    if( evict_idx < 0 )
+      return;
+
+    /// the newcomer is the least certain hypothesis, so it is the one to drop
+    if( new_storage.det_ >= pool.storage_[ evict_idx ].det_ )
+      {
+	ROS_DEBUG_STREAM("Pool is full, dropped filter ( " << new_filter.state_.transpose() 
+			 << " ) Det: " << new_storage.det_ << "." );
+	return;
+      }
+
+    ROS_DEBUG_STREAM("Evicted filter ( " << pool.filters_.state( evict_idx ).transpose() 
+		     << " ) Det: " << pool.storage_[ evict_idx ].det_ << " to spawn filter ( " 
+		     << new_filter.state_.transpose() << " ).");
+    pool.set( evict_idx, new_filter, new_storage );
+  }
   
   /// cache camera info
   void cameraInfoCallback( _CameraInfo::ConstPtr const & msg )
@@ -333,6 +765,20 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 
     tracker.config_ = config;
 
+    /// keep the pool at its capacity so that spawning filters never reallocates
+    FilterPool & pool = tracker.filters_;
+    std::vector<unsigned int> evicted_ids;
+    truncatePool( pool, config.max_hypotheses, evicted_ids );
+    pool.reserve( config.max_hypotheses );
+
+    /// otherwise replaying a late measurement would restore the old number of hypotheses
+    for( TrackerSnapshot & snapshot : tracker.history_ )
+      {
+	snapshot.filters_.remove( evicted_ids );
+	truncatePool( snapshot.filters_, config.max_hypotheses, evicted_ids );
+      }
+    tracker.estimates_.reserve( config.max_hypotheses );
+
     ROS_INFO("Updated tracker params [ %s ].", type.c_str() );
   }
 
@@ -349,7 +795,7 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
     config_ = config;
   }
 
- private:
+ protected:
 
   // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
   /// TODO: Catch XML exception
@@ -402,7 +848,8 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	ObjectTrackerStorage tracker;
 	tracker.type_ = object_it->first;
 	tracker.ideal_radius_ = object_it->second["ideal_radius"];
-	tracker.last_predict_time_ = ros::Time::now();
+	/// set by the first measurement
+	tracker.last_predict_time_ = ros::Time();
 
 	for(_NamedXmlMap::iterator color_it = xml_colors.begin(); color_it != xml_colors.end(); ++color_it)
 	  {
@@ -441,74 +888,113 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 
     std::vector< tf::StampedTransform > object_transforms;
     _TrackedObjectArrayMsg tracked_objects;
-    
+
+    /// The observer transform is the same for every filter, so only look it up once per tick
+    tf::StampedTransform motion_to_observer_tf;
+    bool const have_observer_tf = lookupObserverTransform( motion_to_observer_tf );
+
+    updateEstimates( ros::Time::now(), have_observer_tf, motion_to_observer_tf,
+		     tracked_objects, object_transforms );
+
+    if( !have_observer_tf )
+      return;
+
+    tracked_object_pub_.publish( tracked_objects );
+    /// all of the objects go out in a single tf message
+    if( !object_transforms.empty() )
+      object_broadcaster_.sendTransform( object_transforms );
+    return;
+  }
+
+  /**
+   * Extrapolate every tracker's filters to now, remove the ones whose variance has grown
+   * too large and build the estimates of the remaining ones.
+   *
+   * @param now Time to extrapolate the filters to
+   * @param have_observer_tf If false, filters are only pruned and no estimates are built
+   * @param motion_to_observer_tf Transform from the motion frame to the camera frame
+   * @param tracked_objects Output estimates
+   * @param object_transforms Output transforms from the motion frame to each estimate
+   */
+  void updateEstimates( ros::Time const & now, bool const & have_observer_tf,
+			tf::Transform const & motion_to_observer_tf,
+			_TrackedObjectArrayMsg & tracked_objects,
+			std::vector< tf::StampedTransform > & object_transforms )
+  {
     for( _NamedTrackerMap::iterator tracker_it = trackers_.begin(); tracker_it != trackers_.end();
 	 ++tracker_it)
       {
 	ObjectTrackerStorage & storage = tracker_it->second;
 
-	/// Control input step
-	ros::Time now = ros::Time::now();
-	double dt = (now - storage.last_predict_time_).toSec();
-	storage.last_predict_time_ = now;
-	_ObjectKalmanFilter::StateMatrix state_transition;
-	/// The second term is respondible for integrating velocity and adding to pos.
-	state_transition <<
-	  _PositionUpdate::CovarianceType::Identity(),
-	  _PositionUpdate::CovarianceType::Identity() * dt, 
-	  _PositionUpdate::CovarianceType::Zero(),
-	  _PositionUpdate::CovarianceType::Identity();
+	/// Filters stay at the time of the latest measurement. Extrapolate copies of them to now.
+	double const dt = std::max( 0.0, ( now - storage.last_predict_time_ ).toSec() );
+	_ObjectMotionModel const motion_model( dt );
+	_FullStateControl::CovarianceType const process_noise = processNoise( dt );
 	
 	// ################################################################
-	// Remove filters whose variance exceeds a threshold ##############
+	// Remove filters whose extrapolated variance exceeds a threshold #
 	// ################################################################
 
-	int idx = 0;
 	int min_idx = 0;
 	double min_det = -1;
-	_KalmanFilterVector & filters = storage.filters_;
-	_KalmanFilterVector surviving_filters;
-	for(_KalmanFilterVector::iterator filter_it = filters.begin(); filter_it != filters.end();
-	    ++filter_it )
+	FilterPool & pool = storage.filters_;
+	_ObjectKalmanBank & estimates = storage.estimates_;
+
+	/// no control input. All of the tracker's filters are extrapolated in one sweep.
+	estimates = pool.filters_;
+	estimates.predict( motion_model, process_noise );
+	
+	/// compact surviving filters towards the front of the pool in place
+	unsigned int keep_idx = 0;
+	std::vector<unsigned int> killed_ids;
+	for(unsigned int filter_idx = 0; filter_idx < pool.size(); ++filter_idx )
 	  {
-	    _ObjectKalmanFilter & filter = filter_it->filter_;
-	    
-	    /// no control input
-	    filter.predict<8>( _FullStateControl::VectorType::Zero(),
-				   control_cov_, state_transition );
-	    
-	    double const det = Eigen::PartialPivLU<_ObjectKalmanFilter::StateMatrix>( filter.cov_ ).determinant();
+	    double const det = covarianceDeterminant( estimates.cov( filter_idx ) );
+	    pool.storage_[ filter_idx ].estimate_det_ = det;
 	    if( det <= config_.kill_var )
 	      {
-	
-		surviving_filters.push_back( *filter_it );
+		if( keep_idx != filter_idx )
+		  {
+		    pool.move( filter_idx, keep_idx );
+		    estimates.move( filter_idx, keep_idx );
+		  }
 		
 		if( det < min_det || min_det < 0 )
 		  {
 		    min_det = det;
-		    min_idx = idx;
+		    min_idx = keep_idx;
 		  }
-		++idx;
+		++keep_idx;
 	      }
 	    else
 	      {
-		ROS_DEBUG_STREAM("Killed filter ( " << filter.state_.transpose() << " ) Det: " << det << ".");
+		ROS_DEBUG_STREAM("Killed filter ( " << estimates.state( filter_idx ).transpose() << " ) Det: " << det << ".");
+		killed_ids.push_back( pool.storage_[ filter_idx ].id_ );
 	      }
 	  }
-	storage.filters_ = surviving_filters;
+	pool.resize( keep_idx );
+	estimates.resize( keep_idx );
+
+	/// otherwise replaying a late measurement would bring the killed filters back
+	if( !killed_ids.empty() )
+	  {
+	    for( TrackerSnapshot & snapshot : storage.history_ )
+	      snapshot.filters_.remove( killed_ids );
+	  }
+
+	/// keep pruning the other trackers, but there is nothing to publish without the observer
+	if( !have_observer_tf )
+	  continue;
 	    
 	// ################################################################
 	// Publish filter estimates. Lowest variance filter gets primary tf
 	// ################################################################
 	
-	idx = 0;
 	int aux_idx = 0;    
-	for(_KalmanFilterVector::iterator filter_it = filters.begin(); filter_it != filters.end();
-	    ++filter_it, ++idx)
+	for(int idx = 0; idx < int( pool.size() ); ++idx )
 	  {
-	    _ObjectKalmanFilter & filter = filter_it->filter_;
-	    
-	    _ObjectKalmanFilter::StateVector const & state = filter.state_;
+	    FilterStorage const & filter_storage = pool.storage_[ idx ];
+	    _ObjectKalmanFilter::StateVector const state = estimates.state( idx );
 	    
 	    tf::Vector3 observer_to_object_vec = tf::Vector3( state(0), state(1), state(2) );
 	    /// setRPY uses R=around X, P=around Y, Y=around Z, so we are rotating around Z
@@ -518,24 +1004,6 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	    tf::Transform observer_to_object_tf = tf::Transform( observer_to_object_quat,
 								 observer_to_object_vec );
 	    
-	    tf::StampedTransform motion_to_observer_tf;
-
-	    /// get the transform from the motion frame (CM on the physical robot) to the camera frame
-	    if( tf_listener_.canTransform( motion_frame_, last_camera_info_.header.frame_id, ros::Time(0) ))
-	      {
-		try
-		  {
-		    tf_listener_.lookupTransform( motion_frame_, last_camera_info_.header.frame_id, ros::Time(0), motion_to_observer_tf );
-		  }
-		catch(tf::TransformException & ex)
-		  {
-		    ROS_ERROR( "Caught exception [ %s ] looking up transform", ex.what() );
-		    return;
-		  }
-	      }
-	    else 
-	      return;
-
 	    tf::Transform motion_to_object_tf = motion_to_observer_tf * observer_to_object_tf;
 
 	    std::string frame_name;
@@ -551,19 +1019,19 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	      }
 
 	    /// Add TrackedObject msg for object
-	    /// TODO: Don't recalulate det, add color, add children, add covariance for pose
-	    double const det = Eigen::PartialPivLU<_ObjectKalmanFilter::StateMatrix>( filter.cov_ ).determinant();
+	    /// TODO: add children, add covariance for pose
+	    double const det = filter_storage.estimate_det_;
 	    if( det <= config_.pass_var )
 	      {
 		_TrackedObjectMsg object;
 		object.variance = det;
 		object.symmetry = storage.config_.symmetry;
-		object.color = filter_it->color_;
+		object.color = filter_storage.color_;
 		object.type = storage.type_;
 
 		object.header.frame_id = motion_frame_;
-		/// Time of latest filter prediction, not measurement
-		object.header.stamp = ros::Time::now();
+		/// Extrapolated from the latest measurement
+		object.header.stamp = now;
 
 		if( idx == min_idx )
 		  object.is_best_estimate = true;
@@ -575,10 +1043,7 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 		
 		/// transform from camera to "object/<object name>"
 		/// TODO: Flesh out tracking timeout logic. 
-		/// Currently, transforms only timeout in rviz due to last_update_time_ being too old
-		/// TODO: per above change time to now(), don't let old objects get to this line
-		tf::StampedTransform output( motion_to_object_tf, storage.last_predict_time_,
-					     motion_frame_, frame_name );
+		tf::StampedTransform output( motion_to_object_tf, now, motion_frame_, frame_name );
 		
 		object_transforms.push_back( output ); 
 		
@@ -587,10 +1052,30 @@ class UnimodalObjectTrackerNode: public BaseNode, public MultiReconfigure
 	  }
 
       }
+  }
 
-    tracked_object_pub_.publish( tracked_objects );
-    object_broadcaster_.sendTransform( object_transforms );
-    return;
+  /** 
+   * Get the latest transform from the motion frame (CM on the physical robot) to the camera frame
+   * 
+   * @param motion_to_observer_tf Output transform
+   * 
+   * @return True if the transform is available
+   */
+  bool lookupObserverTransform( tf::StampedTransform & motion_to_observer_tf )
+  {
+    if( !tf_listener_.canTransform( motion_frame_, last_camera_info_.header.frame_id, ros::Time(0) ))
+      return false;
+
+    try
+      {
+	tf_listener_.lookupTransform( motion_frame_, last_camera_info_.header.frame_id, ros::Time(0), motion_to_observer_tf );
+      }
+    catch(tf::TransformException & ex)
+      {
+	ROS_ERROR( "Caught exception [ %s ] looking up transform", ex.what() );
+	return false;
+      }
+    return true;
   }
     
 };
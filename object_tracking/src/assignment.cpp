@@ -0,0 +1,140 @@
+/***************************************************************************
+ *  src/assignment.cpp
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#include <object_tracking/assignment.h>
+
+#include <limits>
+
+namespace uscauv
+{
+
+  double solveAssignment( Eigen::MatrixXd const & cost, std::vector<int> & row_assignment )
+  {
+    int const rows = cost.rows(), cols = cost.cols();
+    row_assignment.assign( rows, -1 );
+
+    if( !rows || !cols )
+      return 0.0;
+
+    /// The algorithm below needs at least as many columns as rows
+    if( rows > cols )
+      {
+	std::vector<int> col_assignment;
+	double const total = solveAssignment( cost.transpose(), col_assignment );
+	for(int col = 0; col < cols; ++col )
+	  if( col_assignment[ col ] >= 0 )
+	    row_assignment[ col_assignment[ col ] ] = col;
+	return total;
+      }
+
+    double const inf = std::numeric_limits<double>::infinity();
+    
+    /// 1-indexed, with row/column 0 acting as the root of each augmenting path
+    std::vector<double> u( rows + 1, 0.0 ), v( cols + 1, 0.0 ), minv( cols + 1 );
+    std::vector<int> p( cols + 1, 0 ), way( cols + 1, 0 );
+    std::vector<char> used( cols + 1 );
+
+    for(int i = 1; i <= rows; ++i )
+      {
+	p[0] = i;
+	int j0 = 0;
+	std::fill( minv.begin(), minv.end(), inf );
+	std::fill( used.begin(), used.end(), false );
+
+	/// Grow a shortest path tree from row i until it reaches a free column
+	do
+	  {
+	    used[j0] = true;
+	    int const i0 = p[j0];
+	    double delta = inf;
+	    int j1 = 0;
+	    
+	    for(int j = 1; j <= cols; ++j )
+	      {
+		if( used[j] )
+		  continue;
+		
+		double const reduced = cost( i0 - 1, j - 1 ) - u[i0] - v[j];
+		if( reduced < minv[j] )
+		  {
+		    minv[j] = reduced;
+		    way[j] = j0;
+		  }
+		if( minv[j] < delta )
+		  {
+		    delta = minv[j];
+		    j1 = j;
+		  }
+	      }
+
+	    for(int j = 0; j <= cols; ++j )
+	      {
+		if( used[j] )
+		  {
+		    u[ p[j] ] += delta;
+		    v[j] -= delta;
+		  }
+		else
+		  minv[j] -= delta;
+	      }
+	    j0 = j1;
+	  } while( p[j0] != 0 );
+
+	/// Flip the assignments along the path
+	do
+	  {
+	    int const j1 = way[j0];
+	    p[j0] = p[j1];
+	    j0 = j1;
+	  } while( j0 );
+      }
+
+    double total = 0.0;
+    for(int j = 1; j <= cols; ++j )
+      {
+	if( p[j] )
+	  {
+	    row_assignment[ p[j] - 1 ] = j - 1;
+	    total += cost( p[j] - 1, j - 1 );
+	  }
+      }
+    
+    return total;
+  }
+  
+} // uscauv
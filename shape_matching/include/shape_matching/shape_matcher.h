@@ -47,8 +47,11 @@
 #include <uscauv_common/image_loader.h>
 #include <uscauv_common/graphics.h>
 #include <uscauv_common/color_codec.h>
+#include <uscauv_common/run_length_contours.h>
 #include <uscauv_common/simple_math.h>
 
+#include <shape_matching/vantage_point_tree.h>
+
 /// opencv
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -86,6 +89,23 @@ struct ContourData
 
 typedef std::map<std::string, ContourData> _NamedContourData;
 typedef std::map<std::string, _Contour> _NamedContourMap;
+/// analyzed contour and the name of the template it matched, kept around for drawing
+typedef std::vector<std::pair<ContourData, std::string> > _DrawnMatches;
+
+/// EMD between two contour signatures using a shared cost matrix
+struct SignatureEMD
+{
+  cv::Mat const * cost_;
+
+SignatureEMD( cv::Mat const * cost = NULL ): cost_( cost ) {}
+
+  double operator()( ContourData const & a, ContourData const & b ) const
+  {
+    return cv::EMD( a.signature_, b.signature_, CV_DIST_USER, *cost_ );
+  }
+};
+
+typedef uscauv::VantagePointTree<ContourData, SignatureEMD> _TemplateIndex;
 
 class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiReconfigure
 {
@@ -94,11 +114,14 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
 
   _NamedContourData templates_;
   _NamedContourMap template_contours_;
+  /// metric index over templates_, with names in the same order as the indexed points
+  _TemplateIndex template_index_;
+  std::vector<std::string> template_names_;
   _ImageLoader template_images_;
   _ShapeMatcherConfig* config_;
-  uscauv::EncodedColorSubscriber encoded_image_sub_;
   
   /// ros interfaces
+  uscauv::EncodedColorSubscriber encoded_image_sub_;
   ros::Publisher match_pub_;
   ros::NodeHandle nh_rel_;
   
@@ -106,7 +129,7 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
   cv::Mat emd_cost_;
 
  public:
- ShapeMatcherNode(): BaseNode("ShapeMatcher"), nh_rel_("~")
+ ShapeMatcherNode(): BaseNode("ShapeMatcher"), template_index_( SignatureEMD( &emd_cost_ ) ), nh_rel_("~")
     {
       
     }
@@ -121,6 +144,8 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
     addImagePublisher( "image_matched", 1);
        
     encoded_image_sub_.subscribe( nh_rel_, "encoded", 1, &ShapeMatcherNode::encodedImageCallback, this );
+    encoded_image_sub_.setEncodedCallback( std::bind( &ShapeMatcherNode::colorEncodedCallback, this, std::placeholders::_1,
+						      std::placeholders::_2, std::placeholders::_3 ) );
        
     /// TODO: Make a MultiPublisher class to make this a little nice
     match_pub_ = nh_rel_.advertise<_MatchedShapeArray>("matched_shapes", 10);
@@ -170,6 +195,23 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
 
  public:
 
+  /** 
+   * Contours are either extracted from every color at once by scanning runs of the encoded image,
+   * or by decoding one mask per color and running the denoising + cv::findContours pipeline.
+   * The latter is the default until the run-length extractor has been validated in the water.
+   * 
+   * @return True if the run-length extractor handled the image, false to have it decoded for encodedImageCallback()
+   */
+  bool colorEncodedCallback( cv::Mat const & encoded, std::vector<std::string> const & names, 
+			     std_msgs::Header const & header )
+  {
+    if( !config_->use_run_length_contours )
+      return false;
+    
+    runLengthContourCallback( encoded, names, header );
+    return true;
+  }
+
   void encodedImageCallback( uscauv::ColorImageMapPtr const & msg, std_msgs::Header const & header )
   {
     /// TODO: Populate this with hierarchy
@@ -226,101 +268,30 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
 	cv::findContours( contour_image, contours, hierarchy, 
 			  CV_RETR_TREE, CV_CHAIN_APPROX_NONE );
     
-	cv::cvtColor( contour_image, contour_image, CV_GRAY2BGR );    
-
-
-	for(unsigned int idx = 0; idx < contours.size(); ++idx)
-	  {
-	    /// If the contour has a parent; it is a child
-	    if( hierarchy[idx][3] != -1 )
-	      {
-		cv::drawContours(contour_image, contours, idx, uscauv::CV_PINK_BGR,
-				 2, 8, hierarchy);
-	      }
-	    else
-	      cv::drawContours(contour_image, contours, idx, uscauv::CV_GREEN_BGR,
-			       2, 8, hierarchy);
-	  }
-
 	// ################################################################
 	// Analyze contours and match shapes ##############################
 	// ################################################################
 
-	cv::Mat match_image;
-	contour_image.copyTo(match_image);
-    
-	for(unsigned int idx = 0; idx < contours.size(); ++idx )
-	  {
-	    ContourData result;
-	    if(analyzeContour( contours[ idx ], result, config_->signature_size ))
-	      continue;
-	
-	    for(_NamedContourData::const_iterator template_it = templates_.begin();
-		template_it != templates_.end(); ++template_it )
-	      {
-		/// calculate EMD using our custom cost matrix
-		double emd = cv::EMD( result.signature_, template_it->second.signature_,
-				      CV_DIST_USER, emd_cost_ );
-		ROS_DEBUG("[ %s ] EMD: %f", template_it->first.c_str(), emd );
-	    
-		if( emd < config_->emd_boundary )
-		  {
-		    /// Draw 
-		    ROS_DEBUG("Match detected.");
-		    result.contour_ = template_it->second.contour_;
-		    drawContour(match_image, result, template_it->first);
-
-		    /// Populate match message
-		    _MatchedShape match;
-
-		    match.x = result.mean_.x;
-		    match.y = result.mean_.y;
-		    match.theta = result.rotation_;
-		    match.scale = result.radius_;
-		
-		    match.color = color_it->first;
-		    match.type = template_it->first;
-
-		    /// Arbitrary measure of confidence. Covariance matrix is diagonal to reflect uncorrelatedness of parameters.
-		    match.covariance = { {emd, 0, 0, 0,
-					  0, emd, 0, 0,
-					  0, 0, emd, 0,
-					  0, 0, 0, emd} };
-
-		    matches.shapes.push_back( match );
-		  }
-	      }
-	
-	    /// finish analyzing, draw
-	    /* cv::Point2f const & mean = result.mean_; */
-
-	    /* ROS_INFO("Got mean %f, %f", mean.x, mean.y ); */
-	    /* ROS_INFO("Got rotation %f.", result.rotation_ * 180 / M_PI); */
-	    /* ROS_INFO("Got bounding circle radius: %f", result.radius_ ); */
-	    /* cv::circle(match_image, mean, result.radius_, uscauv::CV_RED_BGR, 2); */
+	/// Debug images are only rendered when they are requested, so matches are just recorded here
+	bool const is_debug_color = ( color_it->first == config_->debug_color );
+	_DrawnMatches drawn_matches;
 	
-	  }
-    
+	matchContours( color_it->first, contours, matches, is_debug_color ? &drawn_matches : NULL );
 
 	// ################################################################
 	// Publish results ################################################
 	// ################################################################
        
-	if( color_it->first == config_->debug_color )
+	if( is_debug_color )
 	  {
 	    /// sensor_msgs::image_encodings::MONO8 = "mono8", for reference
-	    cv_bridge::CvImage::Ptr denoised_output = boost::make_shared<cv_bridge::CvImage>
-	      ( header, sensor_msgs::image_encodings::MONO8, denoised );
-	    cv_bridge::CvImage::Ptr contour_output = boost::make_shared<cv_bridge::CvImage>
-	      ( header, sensor_msgs::image_encodings::BGR8, contour_image );
-	    cv_bridge::CvImage::Ptr match_output = boost::make_shared<cv_bridge::CvImage>
-	      ( header, sensor_msgs::image_encodings::BGR8, match_image );
-
-	    publishImage(
-			 "image_contours", contour_output, 
-			 "image_denoised", denoised_output,
-			 "image_matched", match_output 
-			 );
+	    publishImageDeferred( "image_denoised", [&]()
+				  {
+				    return boost::make_shared<cv_bridge::CvImage>
+				      ( header, sensor_msgs::image_encodings::MONO8, denoised );
+				  });
+
+	    publishContourImages( header, [&](){ return contour_image; }, contours, hierarchy, drawn_matches );
 	  }
 
       }
@@ -332,6 +303,53 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
     return;
   }
 
+  /** 
+   * Match contours extracted from the runs of the encoded image. Denoising settings do not
+   * apply to this path since there are no per-color images to filter.
+   * 
+   * @param encoded Color-encoded image
+   * @param names Color names in bit order
+   * @param header Header of the encoded image
+   */
+  void runLengthContourCallback( cv::Mat const & encoded, std::vector<std::string> const & names, 
+				 std_msgs::Header const & header )
+  {
+    _MatchedShapeArray matches;
+    matches.header = header;
+    matches.image_rows = encoded.rows;
+    matches.image_cols = encoded.cols;
+
+    uscauv::ColorContourMap color_contours;
+    uscauv::findColorContours( encoded, names, color_contours );
+    
+    for(unsigned int color_idx = 0; color_idx < names.size(); ++color_idx )
+      {
+	std::string const & color = names[ color_idx ];
+	uscauv::ContourSet const & contour_set = color_contours[ color ];
+	
+	bool const is_debug_color = ( color == config_->debug_color );
+	_DrawnMatches drawn_matches;
+
+	matchContours( color, contour_set.contours_, matches, is_debug_color ? &drawn_matches : NULL );
+
+	if( is_debug_color )
+	  {
+	    /// the mask is only decoded if one of the debug images is being watched
+	    publishContourImages( header, [&]()
+				  {
+				    cv::Mat mask;
+				    cv::bitwise_and( encoded, ( 1 << color_idx ), mask );
+				    mask.convertTo( mask, CV_8UC1 );
+				    mask.setTo( 255, mask );
+				    return mask;
+				  }, contour_set.contours_, contour_set.hierarchy_, drawn_matches );
+	  }
+      }
+
+    if (matches.shapes.size() > 0 )
+      match_pub_.publish( matches );
+  }
+
   /// prefer to use config instead of config_ within this function
   void reconfigureCallback( _ShapeMatcherConfig const & config )
   {
@@ -353,11 +371,159 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
 	  }
       }
 
+    /// Signatures and the cost matrix may both have changed, so the index has to be rebuilt
+    std::vector<ContourData> template_signatures;
+    template_names_.clear();
+    for(_NamedContourData::const_iterator template_it = templates_.begin();
+	template_it != templates_.end(); ++template_it )
+      {
+	template_names_.push_back( template_it->first );
+	template_signatures.push_back( template_it->second );
+      }
+    template_index_.build( template_signatures );
+    ROS_INFO("Indexed [ %d ] template signatures.", int(template_index_.size()) );
+
 
     return;
   }
 
  private:
+
+  /** 
+   * Analyze each contour and add a MatchedShape for every template that it matches.
+   * 
+   * @param color Name of the color that the contours were extracted from
+   * @param contours Contours to analyze
+   * @param matches Message that matches are appended to
+   * @param drawn_matches If not NULL, filled with the analyzed contours and template names for drawing
+   */
+  void matchContours( std::string const & color, std::vector<_Contour> const & contours, 
+		      _MatchedShapeArray & matches, _DrawnMatches * drawn_matches )
+  {
+    for(unsigned int idx = 0; idx < contours.size(); ++idx )
+      {
+	ContourData result;
+	if(analyzeContour( contours[ idx ], result, config_->signature_size ))
+	  continue;
+	
+	/// (template index, EMD) for every template within emd_boundary of this contour
+	std::vector<std::pair<int, double> > template_matches;
+	findTemplateMatches( result, config_->emd_boundary, template_matches );
+	    
+	for(std::vector<std::pair<int, double> >::const_iterator match_it = template_matches.begin();
+	    match_it != template_matches.end(); ++match_it )
+	  {
+	    std::string const & template_name = template_names_[ match_it->first ];
+	    ContourData const & template_data = template_index_.point( match_it->first );
+	    double const emd = match_it->second;
+
+	    ROS_DEBUG("[ %s ] Match detected with EMD: %f", template_name.c_str(), emd );
+	    if( drawn_matches )
+	      {
+		result.contour_ = template_data.contour_;
+		drawn_matches->push_back( std::make_pair( result, template_name ) );
+	      }
+
+	    /// Populate match message
+	    _MatchedShape match;
+
+	    match.x = result.mean_.x;
+	    match.y = result.mean_.y;
+	    match.theta = result.rotation_;
+	    match.scale = result.radius_;
+		
+	    match.color = color;
+	    match.type = template_name;
+
+	    /// Arbitrary measure of confidence. Covariance matrix is diagonal to reflect uncorrelatedness of parameters.
+	    match.covariance = { {emd, 0, 0, 0,
+				  0, emd, 0, 0,
+				  0, 0, emd, 0,
+				  0, 0, 0, emd} };
+
+	    matches.shapes.push_back( match );
+	  }
+	
+	/// finish analyzing, draw
+	/* cv::Point2f const & mean = result.mean_; */
+
+	/* ROS_INFO("Got mean %f, %f", mean.x, mean.y ); */
+	/* ROS_INFO("Got rotation %f.", result.rotation_ * 180 / M_PI); */
+	/* ROS_INFO("Got bounding circle radius: %f", result.radius_ ); */
+	/* cv::circle(match_image, mean, result.radius_, uscauv::CV_RED_BGR, 2); */
+      }
+  }
+
+  /** 
+   * Publish the contour and match debug images, if anything is subscribed to them.
+   * 
+   * @param header Header for the output images
+   * @param render_base Callable returning the MONO8 image that contours are drawn over
+   * @param contours Contours to draw
+   * @param hierarchy Contour hierarchy, in cv::findContours format
+   * @param drawn_matches Analyzed contours and the templates they matched
+   */
+  template<class __BaseRenderer>
+    void publishContourImages( std_msgs::Header const & header, __BaseRenderer && render_base,
+			       std::vector<_Contour> const & contours, std::vector<cv::Vec4i> const & hierarchy,
+			       _DrawnMatches const & drawn_matches )
+  {
+    bool const render_contours = hasImageSubscribers( "image_contours" );
+    bool const render_matches = hasImageSubscribers( "image_matched" );
+	    
+    if( !render_contours && !render_matches )
+      return;
+    
+    cv::Mat contour_output_image;
+    drawContourHierarchy( render_base(), contours, hierarchy, contour_output_image );
+		
+    if( render_contours )
+      publishImage( "image_contours", boost::make_shared<cv_bridge::CvImage>
+		    ( header, sensor_msgs::image_encodings::BGR8, contour_output_image ) );
+		
+    if( render_matches )
+      {
+	/// publishImage() copies into the outgoing message, so the contour image can be drawn over
+	cv::Mat & match_image = contour_output_image;
+		    
+	for(_DrawnMatches::const_iterator match_it = drawn_matches.begin();
+	    match_it != drawn_matches.end(); ++match_it )
+	  drawContour( match_image, match_it->first, match_it->second );
+		    
+	publishImage( "image_matched", boost::make_shared<cv_bridge::CvImage>
+		      ( header, sensor_msgs::image_encodings::BGR8, match_image ) );
+      }
+  }
+
+  /** 
+   * Find all templates whose signature is within emd_boundary of the contour's signature.
+   * Uses the vantage point index unless use_template_index is disabled, in which case every
+   * template is compared against the contour.
+   * 
+   * @param result Analyzed contour
+   * @param emd_boundary A template matches if its EMD is below this
+   * @param template_matches Filled with (template index, EMD) pairs in template name order
+   */
+  void findTemplateMatches( ContourData const & result, double const & emd_boundary, 
+			    std::vector<std::pair<int, double> > & template_matches )
+  {
+    if( config_->use_template_index )
+      {
+	template_index_.radiusSearch( result, emd_boundary, template_matches );
+	return;
+      }
+
+    template_matches.clear();
+    for(unsigned int idx = 0; idx < template_index_.size(); ++idx )
+      {
+	/// calculate EMD using our custom cost matrix
+	double const emd = template_index_.metric()( result, template_index_.point( idx ) );
+	ROS_DEBUG("[ %s ] EMD: %f", template_names_[ idx ].c_str(), emd );
+	
+	if( emd < emd_boundary )
+	  template_matches.push_back( std::make_pair( int(idx), emd ) );
+      }
+  }
   
   /// TODO: Fill the contour before doing mean/rotation ops
   int analyzeContour( _Contour const & input, ContourData & result, int nd )
@@ -489,6 +655,26 @@ class ShapeMatcherNode: public BaseNode, public ImageTransceiver, public MultiRe
     return 0;
   }
 
+  /// Draw every contour over the thresholded image, with children in pink and top-level contours in green
+  void drawContourHierarchy( cv::Mat const & contour_image, std::vector<_Contour> const & contours,
+			     std::vector<cv::Vec4i> const & hierarchy, cv::Mat & output )
+  {
+    cv::cvtColor( contour_image, output, CV_GRAY2BGR );
+
+    for(unsigned int idx = 0; idx < contours.size(); ++idx)
+      {
+	/// If the contour has a parent; it is a child
+	if( hierarchy[idx][3] != -1 )
+	  {
+	    cv::drawContours(output, contours, idx, uscauv::CV_PINK_BGR,
+			     2, 8, hierarchy);
+	  }
+	else
+	  cv::drawContours(output, contours, idx, uscauv::CV_GREEN_BGR,
+			   2, 8, hierarchy);
+      }
+  }
+
   /// I copied and pasted a bunch of code from the analyzeContours function because I'm lazy!
   void drawContour(cv::Mat & img, ContourData const & contour_data, std::string const & name = "")
   {
@@ -0,0 +1,206 @@
+/***************************************************************************
+ *  include/shape_matching/template_index_benchmark_node.h
+ *  --------------------
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_SHAPEMATCHING_TEMPLATEINDEXBENCHMARK
+#define USCAUV_SHAPEMATCHING_TEMPLATEINDEXBENCHMARK
+
+// ROS
+#include <ros/ros.h>
+
+// uscauv
+#include <uscauv_common/base_node.h>
+#include <uscauv_common/param_loader.h>
+#include <uscauv_common/simple_math.h>
+#include <uscauv_common/tic_toc.h>
+
+#include <shape_matching/vantage_point_tree.h>
+
+/// opencv
+#include <opencv2/imgproc/imgproc.hpp>
+
+/// EMD between two raw signatures using a shared cost matrix
+struct BenchmarkSignatureEMD
+{
+  cv::Mat const * cost_;
+
+BenchmarkSignatureEMD( cv::Mat const * cost = NULL ): cost_( cost ) {}
+
+  double operator()( cv::Mat const & a, cv::Mat const & b ) const
+  {
+    return cv::EMD( a, b, CV_DIST_USER, *cost_ );
+  }
+};
+
+/**
+ * Compares the vantage point template index against a linear scan as the template count grows.
+ * Templates are synthetic radial signatures generated as small perturbations of a few base shapes,
+ * which mirrors a library made of many rotations and variants of a handful of objects.
+ */
+class TemplateIndexBenchmarkNode: public BaseNode
+{
+ private:
+  typedef uscauv::VantagePointTree<cv::Mat, BenchmarkSignatureEMD> _SignatureIndex;
+
+  cv::Mat emd_cost_;
+  cv::RNG rng_;
+  
+ public:
+ TemplateIndexBenchmarkNode(): BaseNode("TemplateIndexBenchmark")
+    {
+    }
+
+ private:
+
+  // Running spin() will cause this function to be called before the node begins looping the spinOnce() function.
+  void spinFirst()
+  {
+    ros::NodeHandle nh_rel("~");
+
+    int const signature_size = uscauv::param::load<int>( nh_rel, "signature_size", 20 );
+    int const base_shapes = uscauv::param::load<int>( nh_rel, "base_shapes", 5 );
+    int const max_templates = uscauv::param::load<int>( nh_rel, "max_templates", 1024 );
+    int const queries = uscauv::param::load<int>( nh_rel, "queries", 200 );
+    double const emd_boundary = uscauv::param::load<double>( nh_rel, "emd_boundary", 0.15 );
+    double const variation = uscauv::param::load<double>( nh_rel, "variation", 0.3 );
+    
+    emd_cost_.create( signature_size, signature_size, CV_32FC1 );
+    for(int idy = 0; idy < signature_size; ++idy )
+      {
+	float * cost_row = emd_cost_.ptr<float>( idy );
+	for(int idx = 0; idx < signature_size; ++idx )
+	  cost_row[ idx ] = uscauv::ring_distance<int>( idx, idy, signature_size );
+      }
+
+    std::vector<cv::Mat> bases;
+    for(int idx = 0; idx < base_shapes; ++idx )
+      bases.push_back( randomSignature( signature_size ) );
+
+    for(int template_count = 8; template_count <= max_templates; template_count *= 2 )
+      {
+	std::vector<cv::Mat> templates;
+	for(int idx = 0; idx < template_count; ++idx )
+	  templates.push_back( perturbSignature( bases[ idx % base_shapes ], variation ) );
+
+	std::vector<cv::Mat> query_signatures;
+	for(int idx = 0; idx < queries; ++idx )
+	  query_signatures.push_back( perturbSignature( templates[ rng_.uniform( 0, template_count ) ], variation ) );
+
+	BenchmarkSignatureEMD const metric( &emd_cost_ );
+	_SignatureIndex index( metric );
+	index.build( templates );
+
+	std::vector<std::pair<int, double> > linear_matches, index_matches;
+	unsigned int mismatches = 0, index_evaluations = 0, total_matches = 0;
+	double linear_us = 0, index_us = 0;
+	
+	for(std::vector<cv::Mat>::const_iterator query_it = query_signatures.begin();
+	    query_it != query_signatures.end(); ++query_it )
+	  {
+	    {
+	      tic;
+	      linear_matches.clear();
+	      for(int idx = 0; idx < template_count; ++idx )
+		{
+		  double const emd = metric( *query_it, templates[ idx ] );
+		  if( emd < emd_boundary )
+		    linear_matches.push_back( std::make_pair( idx, emd ) );
+		}
+	      linear_us += toc( std::chrono::microseconds );
+	    }
+	    {
+	      tic;
+	      index.radiusSearch( *query_it, emd_boundary, index_matches );
+	      index_us += toc( std::chrono::microseconds );
+	    }
+
+	    index_evaluations += index.lastEvaluations();
+	    total_matches += linear_matches.size();
+	    if( !sameMatches( linear_matches, index_matches ) )
+	      ++mismatches;
+	  }
+
+	ROS_INFO( "templates: %5d | linear: %9.1f us/query | index: %9.1f us/query, %7.1f EMD/query | matches/query: %5.1f | mismatches: %u",
+		  template_count, linear_us / queries, index_us / queries, double(index_evaluations) / queries,
+		  double(total_matches) / queries, mismatches );
+      }
+
+    ros::shutdown();
+  }  
+
+  // Running spin() will cause this function to get called at the loop rate until this node is killed.
+  void spinOnce()
+  {
+
+  }
+
+  /// Smooth positive signature normalized to a pdf, like the ones produced by analyzeContour
+  cv::Mat randomSignature( int const & nd )
+  {
+    cv::Mat signature( nd, 1, CV_32FC1 );
+    for(int idx = 0; idx < nd; ++idx )
+      signature.at<float>( idx ) = rng_.uniform( 0.2f, 1.0f );
+    
+    cv::Scalar const signature_sum = cv::sum( signature );
+    return signature * ( 1.0 / signature_sum[0] );
+  }
+
+  cv::Mat perturbSignature( cv::Mat const & signature, double const & variation )
+  {
+    cv::Mat output = signature.clone();
+    float const mean = 1.0f / output.rows;
+    for(int idx = 0; idx < output.rows; ++idx )
+      output.at<float>( idx ) = std::max( 0.0f, output.at<float>( idx ) + float( rng_.gaussian( variation * mean ) ) );
+    
+    cv::Scalar const signature_sum = cv::sum( output );
+    return output * ( 1.0 / signature_sum[0] );
+  }
+
+  /// EMD is only computed to float precision, so distances are not compared exactly
+  bool sameMatches( std::vector<std::pair<int, double> > const & a, std::vector<std::pair<int, double> > const & b )
+  {
+    if( a.size() != b.size() )
+      return false;
+    
+    for(unsigned int idx = 0; idx < a.size(); ++idx )
+      if( a[idx].first != b[idx].first )
+	return false;
+
+    return true;
+  }
+};
+
+#endif // USCAUV_SHAPEMATCHING_TEMPLATEINDEXBENCHMARK
@@ -0,0 +1,189 @@
+/***************************************************************************
+ *  include/shape_matching/vantage_point_tree.h
+ *  --------------------
+ *
+ *  Copyright (c) 2013, Dylan Foster
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_SHAPEMATCHING_VANTAGEPOINTTREE
+#define USCAUV_SHAPEMATCHING_VANTAGEPOINTTREE
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+namespace uscauv
+{
+
+  /**
+   * Metric tree over an arbitrary point type. __Metric must be a functor
+   * double(__Point const &, __Point const &) that satisfies the triangle inequality
+   * (EMD between equal-mass signatures with a metric ground distance does).
+   * Radius queries prune every subtree whose shell cannot contain a match, so for
+   * well-spread data they evaluate the metric a sublinear number of times.
+   */
+  template<class __Point, class __Metric>
+    class VantagePointTree
+  {
+  private:
+    struct Node
+    {
+      int index_;        /// index of the vantage point in points_
+      double threshold_; /// median distance from the vantage point to its subtree
+      int inside_;       /// child holding points with distance <= threshold_
+      int outside_;      /// child holding points with distance >= threshold_
+    };
+
+    std::vector<__Point> points_;
+    std::vector<Node> nodes_;
+    __Metric metric_;
+    int root_;
+    
+    /// number of metric evaluations performed by the last query
+    mutable unsigned int evaluations_;
+
+  public:
+  VantagePointTree(__Metric const & metric = __Metric()): metric_(metric), root_(-1), evaluations_(0) {}
+
+    void build( std::vector<__Point> const & points )
+    {
+      points_ = points;
+      nodes_.clear();
+      nodes_.reserve( points_.size() );
+
+      std::vector<std::pair<double, int> > items( points_.size() );
+      for(unsigned int idx = 0; idx < items.size(); ++idx)
+	items[idx] = std::make_pair( 0.0, int(idx) );
+      
+      root_ = buildRecursive( items, 0, items.size() );
+    }
+
+    void clear()
+    {
+      points_.clear();
+      nodes_.clear();
+      root_ = -1;
+    }
+    
+    /** 
+     * Find every point within radius of the query.
+     * 
+     * @param query Point to search around
+     * @param radius Matches are strictly closer than this
+     * @param results Filled with (index, distance) pairs, sorted by index so that results
+     * come out in the same order as a linear scan over the input to build()
+     */
+    void radiusSearch( __Point const & query, double const & radius, 
+		       std::vector<std::pair<int, double> > & results ) const
+    {
+      results.clear();
+      evaluations_ = 0;
+      
+      if( root_ >= 0 )
+	searchRecursive( root_, query, radius, results );
+      
+      std::sort( results.begin(), results.end() );
+    }
+
+    __Point const & point( int const & index ) const
+    {
+      return points_[ index ];
+    }
+
+    __Metric & metric() { return metric_; }
+    
+    unsigned int size() const { return points_.size(); }
+
+    unsigned int lastEvaluations() const { return evaluations_; }
+    
+  private:
+    
+    int buildRecursive( std::vector<std::pair<double, int> > & items, int const & lower, int const & upper )
+    {
+      if( upper <= lower )
+	return -1;
+
+      Node node;
+      node.index_ = items[ lower ].second;
+      node.threshold_ = 0.0;
+      node.inside_ = -1;
+      node.outside_ = -1;
+      
+      int const node_idx = nodes_.size();
+      nodes_.push_back( node );
+
+      if( upper - lower == 1 )
+	return node_idx;
+      
+      __Point const & vantage = points_[ node.index_ ];
+      for(int idx = lower + 1; idx < upper; ++idx)
+	items[idx].first = metric_( vantage, points_[ items[idx].second ] );
+
+      /// Split the remaining points at the median distance from the vantage point
+      int const median = ( lower + 1 + upper ) / 2;
+      std::nth_element( items.begin() + lower + 1, items.begin() + median, items.begin() + upper );
+
+      nodes_[ node_idx ].threshold_ = items[ median ].first;
+      /// Elements equal to the median may land on either side of it, so the inside set
+      /// runs through the median itself
+      int const inside = buildRecursive( items, lower + 1, median + 1 );
+      int const outside = buildRecursive( items, median + 1, upper );
+      nodes_[ node_idx ].inside_ = inside;
+      nodes_[ node_idx ].outside_ = outside;
+      
+      return node_idx;
+    }
+
+    void searchRecursive( int const & node_idx, __Point const & query, double const & radius,
+			  std::vector<std::pair<int, double> > & results ) const
+    {
+      Node const & node = nodes_[ node_idx ];
+
+      double const distance = metric_( query, points_[ node.index_ ] );
+      ++evaluations_;
+      
+      if( distance < radius )
+	results.push_back( std::make_pair( node.index_, distance ) );
+
+      if( node.inside_ >= 0 && distance - radius <= node.threshold_ )
+	searchRecursive( node.inside_, query, radius, results );
+      
+      if( node.outside_ >= 0 && distance + radius >= node.threshold_ )
+	searchRecursive( node.outside_, query, radius, results );
+    }
+    
+  };
+  
+} // uscauv
+
+#endif // USCAUV_SHAPEMATCHING_VANTAGEPOINTTREE
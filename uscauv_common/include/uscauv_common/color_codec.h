@@ -58,6 +58,28 @@ namespace uscauv
   typedef std::shared_ptr<ColorImageMap> ColorImageMapPtr;
   typedef std::shared_ptr<ColorImageMap const> ColorImageMapConstPtr;
   
+  /** 
+   * Split a color-encoded image into one MONO8 mask (0 or 255) per color.
+   * 
+   * @param encoded Image with encoding COLOR_CODEC_IMAGE_TYPE, where bit i is set for pixels of names[i]
+   * @param names Color names in bit order
+   * @param decoded Output map from color name to mask
+   */
+  inline void decodeColorImage( cv::Mat const & encoded, std::vector<std::string> const & names, ColorImageMap & decoded )
+  {
+    unsigned int color_idx = 0;
+    for(std::vector<std::string>::const_iterator name_it = names.begin();
+	name_it != names.end(); ++name_it, ++color_idx)
+      {
+	cv::Mat output;
+	cv::bitwise_and(encoded, (1 << color_idx) , output);
+	/* ROS_DEBUG("Decoding with key %d", (1 << color_idx)); */
+	output.convertTo( output, CV_8UC1 );
+	output.setTo( 255, output );
+	decoded.insert( std::pair<std::string, cv::Mat>( *name_it, output ));
+      }
+  }
+
   class ColorEncoder
   {
   private:
@@ -115,10 +137,15 @@ namespace uscauv
 
   class EncodedColorSubscriber
   {
+  public:
+    /// Gets the encoded image and its color names. Returns true if it handled the message, in which case it isn't decoded.
+    typedef std::function< bool( cv::Mat const &, std::vector<std::string> const &, std_msgs::Header const & )> _EncodedCallback;
+    
   private:
     
     ros::Subscriber sub_;
     std::function< void( ColorImageMapPtr const &, std_msgs::Header const &)> external_callback;
+    _EncodedCallback encoded_callback_;
 
   public:
     template<class... __BoundArgs>
@@ -129,23 +156,24 @@ namespace uscauv
 	external_callback = std::bind( std::forward<__BoundArgs>(bound_args)...,
 				       std::placeholders::_1, std::placeholders::_2);
       }
+
+    /// For subscribers that can work on the encoded image directly, e.g. uscauv::findColorContours()
+    void setEncodedCallback( _EncodedCallback const & callback )
+    {
+      encoded_callback_ = callback;
+    }
     
   private:
     void decode( auv_msgs::ColorEncodedImage::ConstPtr const & msg)
     {
-      ColorImageMapPtr decoded = std::make_shared<ColorImageMap>();
+      /// every mask is written to its own buffer, so the message data can be shared instead of copied
+      cv_bridge::CvImageConstPtr const encoded = cv_bridge::toCvShare( msg->image, msg, COLOR_CODEC_IMAGE_TYPE );
       
-      unsigned int color_idx = 0;
-      for(std::vector<std::string>::const_iterator name_it = msg->encoding.begin();
-	  name_it != msg->encoding.end(); ++name_it, ++color_idx)
-	{
-	  cv::Mat output = cv_bridge::toCvCopy( msg->image, COLOR_CODEC_IMAGE_TYPE )->image;
-	  cv::bitwise_and(output, (1 << color_idx) , output);
-	  /* ROS_DEBUG("Decoding with key %d", (1 << color_idx)); */
-	  output.convertTo( output, CV_8UC1 );
-	  output.setTo( 255, output );
-	  decoded->insert( std::pair<std::string, cv::Mat>( *name_it, output ));
-	}
+      if( encoded_callback_ && encoded_callback_( encoded->image, msg->encoding, msg->image.header ) )
+	return;
+      
+      ColorImageMapPtr decoded = std::make_shared<ColorImageMap>();
+      decodeColorImage( encoded->image, msg->encoding, *decoded );
       
       if( external_callback )
 	external_callback( decoded, msg->image.header );
@@ -0,0 +1,166 @@
+/***************************************************************************
+ *  include/uscauv_common/command_trace.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_USCAUVCOMMON_COMMANDTRACE
+#define USCAUV_USCAUVCOMMON_COMMANDTRACE
+
+#include <ros/ros.h>
+
+#include <auv_msgs/CommandTrace.h>
+
+#include <atomic>
+
+namespace uscauv
+{
+  typedef auv_msgs::CommandHop _CommandHopMsg;
+  typedef auv_msgs::CommandTrace _CommandTraceMsg;
+
+  /** 
+   * Start tracing a command, in the node that sends it
+   * 
+   * @param trace Trace of the outgoing message
+   */
+  inline void startCommandTrace( _CommandTraceMsg & trace )
+  {
+    /// unique per sender, which is all the collector needs
+    static std::atomic<unsigned int> next_id( 1 );
+    
+    trace.id = next_id++;
+    if( !trace.id )
+      trace.id = next_id++;
+    
+    trace.origin = ros::Time::now();
+    trace.hops.clear();
+  }
+
+  inline bool isTraced( _CommandTraceMsg const & trace )
+  {
+    return trace.id;
+  }
+
+  /** 
+   * Record that a node passed a traced command on. Does nothing if the command isn't traced.
+   * 
+   * @param trace Trace of the outgoing message
+   * @param stage One of the stages in CommandHop.msg
+   * @param received When the node got the command
+   * @param sent When the node passed it on
+   */
+  inline void appendCommandHop( _CommandTraceMsg & trace, unsigned char const & stage,
+				ros::Time const & received, ros::Time const & sent = ros::Time::now() )
+  {
+    if( !isTraced( trace ) )
+      return;
+
+    _CommandHopMsg hop;
+    hop.stage = stage;
+    hop.received = received;
+    hop.sent = sent;
+    trace.hops.push_back( hop );
+  }
+
+  inline char const * getCommandStageName( unsigned char const & stage )
+  {
+    switch( stage )
+      {
+      case _CommandHopMsg::CONTROL_SERVER:  return "control_server";
+      case _CommandHopMsg::THRUSTER_MAPPER: return "thruster_mapper";
+      case _CommandHopMsg::SEABEE3_ADAPTER: return "seabee3_adapter";
+      default:                              return "unknown";
+      }
+  }
+
+  /**
+   * A trace that doesn't own any memory, so that it can go through a DoubleBuffer to another thread.
+   * Hops past MAX_HOPS are dropped.
+   */
+  struct CommandTraceData
+  {
+    static unsigned int const MAX_HOPS = 8;
+    
+    struct Hop
+    {
+      unsigned char stage_;
+      ros::Time received_, sent_;
+    };
+
+    unsigned int id_;
+    ros::Time origin_;
+    unsigned int num_hops_;
+    Hop hops_[ MAX_HOPS ];
+
+  CommandTraceData(): id_( 0 ), num_hops_( 0 ) {}
+
+    void fromMsg( _CommandTraceMsg const & trace )
+    {
+      id_ = trace.id;
+      origin_ = trace.origin;
+      num_hops_ = 0;
+      for( _CommandHopMsg const & hop : trace.hops )
+	appendHop( hop.stage, hop.received, hop.sent );
+    }
+
+    void toMsg( _CommandTraceMsg & trace ) const
+    {
+      trace.id = id_;
+      trace.origin = origin_;
+      trace.hops.resize( num_hops_ );
+      for( unsigned int idx = 0; idx < num_hops_; ++idx )
+	{
+	  trace.hops[ idx ].stage = hops_[ idx ].stage_;
+	  trace.hops[ idx ].received = hops_[ idx ].received_;
+	  trace.hops[ idx ].sent = hops_[ idx ].sent_;
+	}
+    }
+
+    void appendHop( unsigned char const & stage, ros::Time const & received, ros::Time const & sent )
+    {
+      if( !id_ || num_hops_ == MAX_HOPS )
+	return;
+
+      Hop & hop = hops_[ num_hops_++ ];
+      hop.stage_ = stage;
+      hop.received_ = received;
+      hop.sent_ = sent;
+    }
+  };
+  
+} // uscauv
+
+#endif // USCAUV_USCAUVCOMMON_COMMANDTRACE
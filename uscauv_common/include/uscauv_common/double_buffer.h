@@ -0,0 +1,120 @@
+/***************************************************************************
+ *  include/uscauv_common/double_buffer.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef USCAUV_USCAUVCOMMON_DOUBLEBUFFER
+#define USCAUV_USCAUVCOMMON_DOUBLEBUFFER
+
+#include <atomic>
+
+namespace uscauv
+{
+
+  /**
+   * Hands the latest value of some plain data from one writer thread to one reader thread without locking.
+   * The writer fills whichever slot the reader isn't supposed to be using and then publishes it, so it
+   * never waits. The reader copies the latest slot and retries if the writer started overwriting it
+   * in the meantime, which can only happen if the writer wrote twice during one copy.
+   *
+   * __Data is copied while the other thread may be writing it, so it must not own any memory
+   * (no strings, vectors or pointers).
+   */
+  template<class __Data>
+    class DoubleBuffer
+    {
+    private:
+      __Data slots_[2];
+      /// number of completed writes. The latest one is in slots_[ version_ & 1 ]
+      std::atomic<unsigned int> version_;
+      /// number of started writes
+      std::atomic<unsigned int> pending_;
+
+    public:
+    DoubleBuffer(): version_( 0 ), pending_( 0 ) {}
+
+      /// Only call from the writer thread
+      void write( __Data const & data )
+      {
+	unsigned int const version = version_.load( std::memory_order_relaxed );
+	
+	pending_.store( version + 1, std::memory_order_relaxed );
+	/// the reader has to see pending_ before it can see any of the new data
+	std::atomic_thread_fence( std::memory_order_release );
+
+	slots_[ ( version + 1 ) & 1 ] = data;
+
+	version_.store( version + 1, std::memory_order_release );
+      }
+
+      /** 
+       * Only call from the reader thread
+       * 
+       * @param data Set to the latest value
+       * 
+       * @return False if nothing has been written yet, in which case data is unchanged
+       */
+      bool read( __Data & data ) const
+      {
+	while( true )
+	  {
+	    unsigned int const version = version_.load( std::memory_order_acquire );
+	    if( !version )
+	      return false;
+
+	    __Data const copy = slots_[ version & 1 ];
+	    std::atomic_thread_fence( std::memory_order_acquire );
+
+	    /// the slot we copied is only written again by write number version + 2
+	    if( pending_.load( std::memory_order_relaxed ) - version <= 1 )
+	      {
+		data = copy;
+		return true;
+	      }
+	  }
+      }
+
+      /// Number of writes so far, so that readers can tell when there is something new
+      unsigned int version() const
+      {
+	return version_.load( std::memory_order_acquire );
+      }
+    };
+  
+} // uscauv
+
+#endif // USCAUV_USCAUVCOMMON_DOUBLEBUFFER
@@ -46,6 +46,10 @@
 #include <image_geometry/pinhole_camera_model.h>
 #include <opencv2/core/core.hpp>
 
+#include <auv_msgs/MatchedShapeArray.h>
+
+#include <vector>
+
 namespace uscauv
 {
   
@@ -63,6 +67,21 @@ namespace uscauv
   tf::Vector3 reprojectObjectTo3d( image_geometry::PinholeCameraModel const & model,
 				   cv::Point2d const & center, double const &radius_pixels,
 				   double const & radius_meters );
+
+  /** 
+   * Reproject the shapes in a matched shape array, assuming that all of them have the same physical size.
+   * The result scales with radius_meters, so shapes of different sizes can be reprojected once with a 
+   * radius of 1 and scaled afterwards.
+   * 
+   * @param model Camera model
+   * @param shapes Matched shapes, with centers and radii (scale) in image coordinates
+   * @param radius_meters Physical radius of the objects, in meters
+   * @param output Vector from the center of the camera to each shape's center, in the same order as shapes
+   * @param selected If not NULL, only the shapes flagged in it are reprojected and the rest are left at zero
+   */
+  void reprojectObjectTo3d( image_geometry::PinholeCameraModel const & model,
+			    auv_msgs::MatchedShapeArray const & shapes, double const & radius_meters,
+			    std::vector<tf::Vector3> & output, std::vector<bool> const * selected = NULL );
   
     
 } // uscauv
@@ -224,6 +224,44 @@ class ImageTransceiver
     publishImage( topic_rel, image->toImageMsg() );
   }
 
+  /** 
+   * Check whether anything is subscribed to an image publisher. This is cheap enough to call
+   * every frame, so nodes can use it to skip work that only feeds debug images.
+   * 
+   * @param topic_rel Publisher topic, relative to node namespace
+   * 
+   * @return true if the publisher exists and has at least one subscriber
+   */
+  bool hasImageSubscribers( std::string const & topic_rel ) const
+  {
+    _NamedPublisherMap::const_iterator pub_it = publishers_.find( nh_rel_.resolveName( topic_rel, true ) );
+    
+    if ( pub_it == publishers_.end() )
+      return false;
+
+    return pub_it->second.getNumSubscribers() > 0;
+  }
+
+  /** 
+   * Publish an image that is only rendered if someone is listening. The renderer is called with
+   * no arguments and must return something that one of the publishImage() overloads above accepts,
+   * e.g. publishImageDeferred( "image_debug", [&](){ return renderDebugImage(); } )
+   * 
+   * @param topic_rel Publisher topic, relative to node namespace
+   * @param render Callable that produces the image
+   * 
+   * @return true if the image was rendered and published
+   */
+  template <class __Renderer>
+    bool publishImageDeferred( std::string const & topic_rel, __Renderer && render ) const
+  {
+    if( !hasImageSubscribers( topic_rel ) )
+      return false;
+
+    publishImage( topic_rel, render() );
+    return true;
+  }
+
     /** 
      * For a variable number of topic/image pairs, call one of the above publishImage functions for each pair
      * e.g. publishImage( "topic1", image1, "topic2", image2, ...)
@@ -44,9 +44,18 @@
 
 #include <uscauv_common/param_loader.h>
 
+#include <algorithm>
+#include <cmath>
+
 namespace uscauv
 {
 
+  /**
+   * Maps keys to values. lookupLinear() and lookupCubic() find the entries around a key with a binary
+   * search and interpolate between them, so they need the table to be sorted by key. The constructor
+   * and fromXmlRpc() take care of this, but if key_ or value_ are changed directly, finalize() has to
+   * be called again.
+   */
   template<class __KeyType, class __ValueType> 
     class LookupTable
   {
@@ -54,6 +63,11 @@ namespace uscauv
     std::vector<__KeyType> key_;
     std::vector<__ValueType> value_;
 
+  private:
+    /// tangents of the monotone cubic interpolant at each key
+    std::vector<double> slope_;
+
+  public:
     LookupTable(){};
   LookupTable(std::vector<__KeyType> const & key,
 	      std::vector<__ValueType> const & value)
@@ -62,8 +76,149 @@ namespace uscauv
       value_(value)
       {
 	assert( key_.size() == value_.size() );
+	finalize();
       }
 
+    unsigned int size() const
+    {
+      return key_.size();
+    }
+
+    /// Sort the entries by key and compute the tangents used by lookupCubic()
+    void finalize()
+    {
+      assert( key_.size() == value_.size() );
+      
+      std::vector<std::pair<__KeyType, __ValueType> > entries;
+      entries.reserve( key_.size() );
+      for( unsigned int idx = 0; idx < key_.size(); ++idx )
+	entries.push_back( std::make_pair( key_[idx], value_[idx] ) );
+
+      std::stable_sort( entries.begin(), entries.end(), 
+			[]( std::pair<__KeyType, __ValueType> const & lhs, std::pair<__KeyType, __ValueType> const & rhs )
+			{ return lhs.first < rhs.first; } );
+      
+      for( unsigned int idx = 0; idx < entries.size(); ++idx )
+	{
+	  key_[idx] = entries[idx].first;
+	  value_[idx] = entries[idx].second;
+	}
+
+      computeSlopes();
+    }
+
+    /// Index of the entry with the largest key that is <= key, limited to the second to last entry. O(log n).
+    int bracket( __KeyType const & key ) const
+    {
+      assert( key_.size() > 1 );
+      
+      int const upper = std::upper_bound( key_.begin(), key_.end(), key ) - key_.begin();
+      return std::min( std::max( upper - 1, 0 ), int( key_.size() ) - 2 );
+    }
+
+    /**
+     * Interpolate linearly between the entries around key. Keys outside of the table get the value at the nearest end.
+     * A key that appears twice is a step, and gets the middle of the step.
+     */
+    __ValueType lookupLinear( __KeyType const & key ) const
+    {
+      assert( key_.size() == value_.size() );
+      assert( key_.size() );
+
+      if( key_.size() == 1 || key <= key_.front() )
+	return value_.front();
+      if( key >= key_.back() )
+	return value_.back();
+
+      int const idx = bracket( key );
+      if( key == key_[idx] && key_[idx - 1] == key )
+	return 0.5 * ( value_[idx - 1] + value_[idx] );
+      
+      double const width = key_[idx + 1] - key_[idx];
+      if( width <= 0 )
+	return value_[idx];
+
+      double const t = ( key - key_[idx] ) / width;
+      return value_[idx] + t * ( value_[idx + 1] - value_[idx] );
+    }
+
+    /**
+     * Interpolate with a monotone cubic (Fritsch-Carlson), which is smooth but never overshoots
+     * between entries. Keys outside of the table get the value at the nearest end.
+     */
+    __ValueType lookupCubic( __KeyType const & key ) const
+    {
+      assert( key_.size() == value_.size() );
+      assert( key_.size() );
+      assert( slope_.size() == key_.size() );
+
+      if( key_.size() == 1 || key <= key_.front() )
+	return value_.front();
+      if( key >= key_.back() )
+	return value_.back();
+
+      int const idx = bracket( key );
+      double const width = key_[idx + 1] - key_[idx];
+      if( width <= 0 )
+	return value_[idx];
+
+      double const t = ( key - key_[idx] ) / width;
+      double const t2 = t*t, t3 = t2*t;
+      
+      return ( 2*t3 - 3*t2 + 1 ) * value_[idx] + ( t3 - 2*t2 + t ) * width * slope_[idx] +
+	( -2*t3 + 3*t2 ) * value_[idx + 1] + ( t3 - t2 ) * width * slope_[idx + 1];
+    }
+
+    /** 
+     * Build the table that maps values back to keys. The values have to be monotone. A run of
+     * equal values, like a thruster's deadband, becomes a step between the first and last of its
+     * keys, so the inverse stays exact on either side of the run. lookupLinear() gives the middle
+     * of the step for the run's value itself.
+     * 
+     * @param inverse Output table
+     * 
+     * @return 0 on success, -1 if the values are not monotone
+     */
+    int invert( LookupTable<__ValueType, __KeyType> & inverse ) const
+    {
+      assert( key_.size() == value_.size() );
+
+      bool increasing = true, decreasing = true;
+      for( unsigned int idx = 1; idx < value_.size(); ++idx )
+	{
+	  increasing = increasing && value_[idx] >= value_[idx - 1];
+	  decreasing = decreasing && value_[idx] <= value_[idx - 1];
+	}
+      if( !increasing && !decreasing )
+	{
+	  ROS_WARN( "Lookup table values are not monotone. Can't invert." );
+	  return -1;
+	}
+
+      inverse.key_.clear();
+      inverse.value_.clear();
+      for( unsigned int first = 0; first < value_.size(); )
+	{
+	  unsigned int last = first;
+	  while( last + 1 < value_.size() && value_[last + 1] == value_[first] )
+	    ++last;
+
+	  /// finalize() keeps equal keys in order, and the step has to go the same way as the values
+	  unsigned int const lower = increasing ? first : last, upper = increasing ? last : first;
+	  inverse.key_.push_back( value_[first] );
+	  inverse.value_.push_back( key_[lower] );
+	  if( upper != lower )
+	    {
+	      inverse.key_.push_back( value_[first] );
+	      inverse.value_.push_back( key_[upper] );
+	    }
+	  first = last + 1;
+	}
+      inverse.finalize();
+      
+      return 0;
+    }
+
     __ValueType lookupBinary(__KeyType const & key, double eps = 0.0) const
     {
       assert( key_.size() == value_.size() );
@@ -134,6 +289,7 @@ namespace uscauv
       
 	  key_ = uscauv::param::XmlRpcValueConverter<std::vector<double> >::convert( xml_key );
 	  value_ = uscauv::param::XmlRpcValueConverter<std::vector<double> >::convert( xml_value );
+	  finalize();
 	}
       catch( XmlRpc::XmlRpcException const & ex )
 	{
@@ -150,6 +306,112 @@ namespace uscauv
       /* 	} */
       return 0;
     }
+
+  private:
+    void computeSlopes()
+    {
+      int const size = key_.size();
+      slope_.assign( size, 0.0 );
+      if( size < 2 )
+	return;
+
+      std::vector<double> secant( size - 1 );
+      for( int idx = 0; idx < size - 1; ++idx )
+	{
+	  double const width = key_[idx + 1] - key_[idx];
+	  secant[idx] = ( width > 0 ) ? ( value_[idx + 1] - value_[idx] ) / width : 0.0;
+	}
+
+      slope_.front() = secant.front();
+      slope_.back() = secant.back();
+      for( int idx = 1; idx < size - 1; ++idx )
+	{
+	  /// flat at local extrema
+	  slope_[idx] = ( secant[idx - 1] * secant[idx] > 0 ) ? 0.5 * ( secant[idx - 1] + secant[idx] ) : 0.0;
+	}
+
+      /// limit the tangents so that the interpolant stays monotone on every interval
+      for( int idx = 0; idx < size - 1; ++idx )
+	{
+	  if( secant[idx] == 0 )
+	    {
+	      slope_[idx] = slope_[idx + 1] = 0;
+	      continue;
+	    }
+	  double const alpha = slope_[idx] / secant[idx], beta = slope_[idx + 1] / secant[idx];
+	  double const norm = alpha*alpha + beta*beta;
+	  if( norm > 9 )
+	    {
+	      double const tau = 3.0 / std::sqrt( norm );
+	      slope_[idx] = tau * alpha * secant[idx];
+	      slope_[idx + 1] = tau * beta * secant[idx];
+	    }
+	}
+    }
+  };
+
+  /**
+   * A lookup table resampled onto evenly spaced keys, so that a lookup is a single multiply
+   * instead of a search. Keys outside of the table get the value at the nearest end.
+   */
+  template<class __KeyType, class __ValueType> 
+    class UniformLookupTable
+  {
+  private:
+    __KeyType min_key_;
+    double inverse_step_;
+    std::vector<__ValueType> value_;
+    
+  public:
+  UniformLookupTable(): min_key_( 0 ), inverse_step_( 0 ) {}
+
+    /** 
+     * @param table Table to resample
+     * @param samples Number of evenly spaced keys. The error of interpolating between them 
+     * shrinks with the square of this on smooth tables, but only linearly at the corners of
+     * a linearly interpolated table.
+     * @param cubic Sample table with lookupCubic() instead of lookupLinear()
+     */
+    void resample( LookupTable<__KeyType, __ValueType> const & table, unsigned int const samples,
+		   bool const & cubic = false )
+    {
+      assert( table.size() );
+      assert( samples > 1 );
+      
+      min_key_ = table.key_.front();
+      double const range = table.key_.back() - table.key_.front();
+      double const step = range / ( samples - 1 );
+      inverse_step_ = ( range > 0 ) ? 1.0 / step : 0.0;
+      
+      value_.resize( samples );
+      for( unsigned int idx = 0; idx < samples; ++idx )
+	{
+	  __KeyType const key = min_key_ + idx * step;
+	  value_[idx] = cubic ? table.lookupCubic( key ) : table.lookupLinear( key );
+	}
+    }
+
+    bool empty() const
+    {
+      return value_.empty();
+    }
+
+    __ValueType lookup( __KeyType const & key ) const
+    {
+      assert( value_.size() > 1 );
+      
+      double const position = ( key - min_key_ ) * inverse_step_;
+      if( position <= 0 )
+	return value_.front();
+
+      if( position >= value_.size() - 1 )
+	return value_.back();
+
+      unsigned int const idx = position;
+
+      double const t = position - idx;
+      return value_[idx] + t * ( value_[idx + 1] - value_[idx] );
+    }
   };
     
 } // uscauv
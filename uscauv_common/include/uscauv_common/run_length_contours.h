@@ -0,0 +1,85 @@
+/***************************************************************************
+ *  include/uscauv_common/run_length_contours.h
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#ifndef USCAUV_USCAUVCOMMON_RUNLENGTHCONTOURS
+#define USCAUV_USCAUVCOMMON_RUNLENGTHCONTOURS
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace uscauv
+{
+  /// Contours and hierarchy in the same layout as cv::findContours
+  struct ContourSet
+  {
+    std::vector<std::vector<cv::Point> > contours_;
+    /// [ next, previous, first child, parent ] for each contour, -1 where there is none
+    std::vector<cv::Vec4i> hierarchy_;
+  };
+
+  typedef std::map<std::string, ContourSet> ColorContourMap;
+
+  /** 
+   * Extract contours for every color of a color-encoded (mono16 bitmask) image at once.
+   * 
+   * Runs of each color bit are collected in a single raster pass and joined into 8-connected
+   * components (and 4-connected background regions) with a union-find over the runs, so no
+   * per-color mask is ever allocated. Each component contributes an outer border and each
+   * enclosed background region a hole border, both traced directly on the bitmask starting
+   * from the run where they first appear. Holes are children of the component that encloses
+   * them and components are children of the hole they sit in, as with CV_RETR_TREE.
+   * 
+   * The borders and the tree match cv::findContours( mask, CV_RETR_TREE, CV_CHAIN_APPROX_NONE )
+   * on each color's mask up to the order of the contours (raster order of their first pixel here)
+   * and the starting point and direction of each border. The one real difference is the image
+   * frame: findContours treats the outermost row and column of pixels as background, whereas here
+   * they are ordinary pixels, so a shape touching the edge of the image keeps its edge pixels.
+   * 
+   * @param encoded CV_16UC1 image where bit i is set for pixels belonging to names[i]
+   * @param names Color names in bit order, as in auv_msgs::ColorEncodedImage::encoding
+   * @param output Filled with one ContourSet per name
+   */
+  void findColorContours( cv::Mat const & encoded, std::vector<std::string> const & names,
+			  ColorContourMap & output );
+    
+} // uscauv
+
+#endif // USCAUV_USCAUVCOMMON_RUNLENGTHCONTOURS
@@ -59,4 +59,22 @@ namespace uscauv
     
     return tf::Vector3( center_meters.x, center_meters.y, center_meters.z );
   }
+
+  void reprojectObjectTo3d( image_geometry::PinholeCameraModel const & model,
+			    auv_msgs::MatchedShapeArray const & shapes, double const & radius_meters,
+			    std::vector<tf::Vector3> & output, std::vector<bool> const * selected )
+  {
+    assert( !selected || selected->size() == shapes.shapes.size() );
+    
+    output.assign( shapes.shapes.size(), tf::Vector3( 0, 0, 0 ) );
+
+    for( unsigned int idx = 0; idx < shapes.shapes.size(); ++idx )
+      {
+	if( selected && !(*selected)[ idx ] )
+	  continue;
+	
+	auv_msgs::MatchedShape const & shape = shapes.shapes[ idx ];
+	output[ idx ] = reprojectObjectTo3d( model, cv::Point2d( shape.x, shape.y ), shape.scale, radius_meters );
+      }
+  }
 }
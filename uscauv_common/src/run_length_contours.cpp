@@ -0,0 +1,397 @@
+/***************************************************************************
+ *  src/run_length_contours.cpp
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#include <uscauv_common/run_length_contours.h>
+
+#include <algorithm>
+
+namespace uscauv
+{
+
+  namespace
+  {
+    /// Maximum number of colors that fit in the mono16 encoding
+    static int const MAX_COLORS = 16;
+
+    /// Moore neighborhood in clockwise order (image coordinates), starting from the west
+    static int const NEIGHBOR_DX[8] = { -1, -1,  0,  1, 1, 1, 0, -1 };
+    static int const NEIGHBOR_DY[8] = {  0, -1, -1, -1, 0, 1, 1,  1 };
+    static int const WEST = 0;
+    static int const SOUTH = 6;
+
+    struct Run
+    {
+      int y_;
+      int x0_; /// first pixel, inclusive
+      int x1_; /// last pixel, inclusive
+      /// Index of the run of the opposite kind that ends just left of this one, -1 at the image border
+      int left_;
+    };
+
+    class DisjointSet
+    {
+    private:
+      std::vector<int> parent_;
+
+    public:
+      int add()
+      {
+	parent_.push_back( parent_.size() );
+	return parent_.size() - 1;
+      }
+
+      int find( int x )
+      {
+	while( parent_[x] != x )
+	  {
+	    parent_[x] = parent_[ parent_[x] ];
+	    x = parent_[x];
+	  }
+	return x;
+      }
+
+      void join( int a, int b )
+      {
+	a = find( a ); b = find( b );
+	/// keep the smaller index as the root so that the outside region stays at zero
+	if( a < b )
+	  parent_[b] = a;
+	else if( b < a )
+	  parent_[a] = b;
+      }
+    };
+
+    /// Runs of one color, labeled as the raster pass goes
+    struct ColorRuns
+    {
+      std::vector<Run> fg_;
+      std::vector<Run> bg_;
+      DisjointSet fg_sets_;
+      DisjointSet bg_sets_;
+      /// [begin, end) of the previous and current rows in fg_ and bg_
+      int fg_prev_, fg_row_, bg_prev_, bg_row_;
+
+      ColorRuns(): fg_prev_(0), fg_row_(0), bg_prev_(0), bg_row_(0)
+      {
+	/// background region zero is everything connected to the image border
+	bg_sets_.add();
+	Run outside = { -1, -1, -1, -1 };
+	bg_.push_back( outside );
+	bg_prev_ = bg_row_ = 1;
+      }
+    };
+
+    /// Join every run in [cur, cur_end) with the runs in [prev, prev_end) that it touches
+    void joinRows( std::vector<Run> const & runs, DisjointSet & sets, int prev, int const & prev_end,
+		   int const & cur, int const & cur_end, int const & slack )
+    {
+      for(int idx = cur; idx < cur_end; ++idx )
+	{
+	  while( prev < prev_end && runs[prev].x1_ + slack < runs[idx].x0_ )
+	    ++prev;
+	  for(int jdx = prev; jdx < prev_end && runs[jdx].x0_ <= runs[idx].x1_ + slack; ++jdx )
+	    sets.join( idx, jdx );
+	}
+    }
+
+    /// Called once the foreground runs of row y are known. Fills in the gaps and labels both kinds.
+    void finishRow( ColorRuns & color, int const & y, int const & rows, int const & cols )
+    {
+      int const fg_end = color.fg_.size();
+      int cursor = 0;
+      
+      for(int idx = color.fg_row_; idx < fg_end; ++idx )
+	{
+	  Run & run = color.fg_[idx];
+	  color.fg_sets_.add();
+	  
+	  if( run.x0_ > cursor )
+	    {
+	      Run gap = { y, cursor, run.x0_ - 1, idx > color.fg_row_ ? idx - 1 : -1 };
+	      color.bg_.push_back( gap );
+	      color.bg_sets_.add();
+	      run.left_ = color.bg_.size() - 1;
+	    }
+	  else
+	    run.left_ = -1;
+	  
+	  cursor = run.x1_ + 1;
+	}
+      if( cursor < cols )
+	{
+	  Run gap = { y, cursor, cols - 1, fg_end > color.fg_row_ ? fg_end - 1 : -1 };
+	  color.bg_.push_back( gap );
+	  color.bg_sets_.add();
+	}
+      
+      int const bg_end = color.bg_.size();
+      for(int idx = color.bg_row_; idx < bg_end; ++idx )
+	{
+	  Run const & gap = color.bg_[idx];
+	  if( y == 0 || y == rows - 1 || gap.x0_ == 0 || gap.x1_ == cols - 1 )
+	    color.bg_sets_.join( 0, idx );
+	}
+
+      /// foreground is 8-connected and background is 4-connected, so that borders never cross
+      joinRows( color.fg_, color.fg_sets_, color.fg_prev_, color.fg_row_, color.fg_row_, fg_end, 1 );
+      joinRows( color.bg_, color.bg_sets_, color.bg_prev_, color.bg_row_, color.bg_row_, bg_end, 0 );
+
+      color.fg_prev_ = color.fg_row_; color.fg_row_ = fg_end;
+      color.bg_prev_ = color.bg_row_; color.bg_row_ = bg_end;
+    }
+    
+    inline bool isSet( cv::Mat const & encoded, unsigned short const & mask, int const & x, int const & y )
+    {
+      return x >= 0 && y >= 0 && x < encoded.cols && y < encoded.rows &&
+	( encoded.ptr<unsigned short>(y)[x] & mask );
+    }
+
+    /** 
+     * Moore neighbor tracing on one bit of the encoded image. The border is followed clockwise,
+     * keeping the background neighbor in the initial backtrack direction on the outside.
+     * Stops when the trace is about to repeat its first step.
+     */
+    void traceBorder( cv::Mat const & encoded, unsigned short const & mask, cv::Point const & start,
+		      int const & backtrack, std::vector<cv::Point> & contour )
+    {
+      contour.clear();
+      contour.push_back( start );
+
+      cv::Point current = start, second;
+      int back = backtrack;
+      size_t const max_length = 4 * size_t( encoded.rows ) * size_t( encoded.cols ) + 8;
+      
+      while( contour.size() < max_length )
+	{
+	  int dir = -1;
+	  for(int step = 1; step <= 8; ++step )
+	    {
+	      int const test = ( back + step ) & 7;
+	      if( isSet( encoded, mask, current.x + NEIGHBOR_DX[test], current.y + NEIGHBOR_DY[test] ) )
+		{
+		  dir = test;
+		  break;
+		}
+	    }
+	  
+	  /// isolated pixel
+	  if( dir < 0 )
+	    return;
+
+	  cv::Point const next( current.x + NEIGHBOR_DX[dir], current.y + NEIGHBOR_DY[dir] );
+
+	  if( contour.size() == 1 && current == start )
+	    second = next;
+	  else if( current == start && next == second )
+	    {
+	      /// the start point was pushed at the beginning and is about to be revisited
+	      contour.pop_back();
+	      return;
+	    }
+
+	  /// The last background neighbor checked becomes the backtrack point, relative to next
+	  int const last = ( dir + 7 ) & 7;
+	  int const bx = current.x + NEIGHBOR_DX[last] - next.x;
+	  int const by = current.y + NEIGHBOR_DY[last] - next.y;
+	  for(back = 0; back < 8 && ( NEIGHBOR_DX[back] != bx || NEIGHBOR_DY[back] != by ); ++back );
+
+	  current = next;
+	  contour.push_back( current );
+	}
+    }
+
+    struct BorderStart
+    {
+      cv::Point start_;
+      int backtrack_;
+      /// index of the outer border or hole border this one is a child of, in the same list
+      int parent_;
+    };
+
+    bool rasterLess( BorderStart const & a, BorderStart const & b )
+    {
+      return a.start_.y < b.start_.y || ( a.start_.y == b.start_.y && a.start_.x < b.start_.x );
+    }
+
+    struct RasterOrder
+    {
+      std::vector<BorderStart> const & borders_;
+      RasterOrder( std::vector<BorderStart> const & borders ): borders_( borders ) {}
+      bool operator()( int const & a, int const & b ) const { return rasterLess( borders_[a], borders_[b] ); }
+    };
+    
+    void buildContours( cv::Mat const & encoded, unsigned short const & mask,
+			ColorRuns & color, ContourSet & output )
+    {
+      /// Union-find roots are the lowest run index of each set, which is where the region first appears
+      std::vector<int> outer_border( color.fg_.size(), -1 ), hole_border( color.bg_.size(), -1 );
+      std::vector<BorderStart> borders;
+      
+      for(unsigned int idx = 0; idx < color.fg_.size(); ++idx )
+	{
+	  if( color.fg_sets_.find( idx ) != int( idx ) )
+	    continue;
+
+	  Run const & run = color.fg_[idx];
+	  BorderStart border = { cv::Point( run.x0_, run.y_ ), WEST, -1 };
+	  outer_border[ idx ] = borders.size();
+	  borders.push_back( border );
+	}
+
+      for(unsigned int idx = 1; idx < color.bg_.size(); ++idx )
+	{
+	  if( color.bg_sets_.find( idx ) != int( idx ) )
+	    continue;
+
+	  /// A hole never touches the image border, so the pixel above its first run is foreground
+	  Run const & run = color.bg_[idx];
+	  BorderStart border = { cv::Point( run.x0_, run.y_ - 1 ), SOUTH, -1 };
+	  hole_border[ idx ] = borders.size();
+	  borders.push_back( border );
+	}
+
+      /// The pixel left of where a region first appears belongs to the region that encloses it
+      for(unsigned int idx = 0; idx < color.fg_.size(); ++idx )
+	{
+	  Run const & run = color.fg_[idx];
+	  if( outer_border[ idx ] < 0 || run.left_ < 0 )
+	    continue;
+	  
+	  int const left_root = color.bg_sets_.find( run.left_ );
+	  if( left_root != 0 )
+	    borders[ outer_border[ idx ] ].parent_ = hole_border[ left_root ];
+	}
+      for(unsigned int idx = 1; idx < color.bg_.size(); ++idx )
+	{
+	  if( hole_border[ idx ] < 0 )
+	    continue;
+	  
+	  borders[ hole_border[ idx ] ].parent_ = outer_border[ color.fg_sets_.find( color.bg_[idx].left_ ) ];
+	}
+
+      /// Order borders the way a raster scan would find them and remap parents to the new order
+      std::vector<int> order( borders.size() ), rank( borders.size() );
+      for(unsigned int idx = 0; idx < order.size(); ++idx )
+	order[idx] = idx;
+      std::stable_sort( order.begin(), order.end(), RasterOrder( borders ) );
+      for(unsigned int idx = 0; idx < order.size(); ++idx )
+	rank[ order[idx] ] = idx;
+
+      output.contours_.resize( borders.size() );
+      output.hierarchy_.assign( borders.size(), cv::Vec4i( -1, -1, -1, -1 ) );
+      
+      /// last child of each border, with the extra slot at the end for top-level borders
+      std::vector<int> last_child( borders.size() + 1, -1 );
+      
+      for(unsigned int idx = 0; idx < order.size(); ++idx )
+	{
+	  BorderStart const & border = borders[ order[idx] ];
+	  traceBorder( encoded, mask, border.start_, border.backtrack_, output.contours_[idx] );
+
+	  int const parent = ( border.parent_ >= 0 ) ? rank[ border.parent_ ] : -1;
+	  int & sibling = last_child[ ( parent >= 0 ) ? parent : borders.size() ];
+	  
+	  output.hierarchy_[idx][3] = parent;
+	  output.hierarchy_[idx][1] = sibling;
+	  if( sibling >= 0 )
+	    output.hierarchy_[ sibling ][0] = idx;
+	  else if( parent >= 0 )
+	    output.hierarchy_[ parent ][2] = idx;
+	  sibling = idx;
+	}
+    }
+  }
+  
+  void findColorContours( cv::Mat const & encoded, std::vector<std::string> const & names,
+			  ColorContourMap & output )
+  {
+    CV_Assert( encoded.type() == CV_16UC1 );
+    CV_Assert( names.size() <= size_t( MAX_COLORS ) );
+
+    output.clear();
+    int const colors = names.size();
+    unsigned short const active = ( colors == MAX_COLORS ) ? 0xFFFF : ( ( 1 << colors ) - 1 );
+
+    std::vector<ColorRuns> runs( colors );
+    int run_start[ MAX_COLORS ];
+    
+    for(int y = 0; y < encoded.rows; ++y )
+      {
+	unsigned short const * row = encoded.ptr<unsigned short>( y );
+	unsigned short previous = 0;
+
+	for(int x = 0; x < encoded.cols; ++x )
+	  {
+	    unsigned short const value = row[x] & active;
+	    unsigned short changed = value ^ previous;
+
+	    /// A bit turning on opens a run of that color and turning off closes one
+	    for(int color = 0; changed; ++color, changed >>= 1 )
+	      {
+		if( !( changed & 1 ) )
+		  continue;
+		
+		if( value & ( 1 << color ) )
+		  run_start[ color ] = x;
+		else
+		  {
+		    Run run = { y, run_start[ color ], x - 1, -1 };
+		    runs[ color ].fg_.push_back( run );
+		  }
+	      }
+	    previous = value;
+	  }
+
+	for(int color = 0; previous; ++color, previous >>= 1 )
+	  {
+	    if( previous & 1 )
+	      {
+		Run run = { y, run_start[ color ], encoded.cols - 1, -1 };
+		runs[ color ].fg_.push_back( run );
+	      }
+	  }
+
+	for(int color = 0; color < colors; ++color )
+	  finishRow( runs[ color ], y, encoded.rows, encoded.cols );
+      }
+
+    for(int color = 0; color < colors; ++color )
+      buildContours( encoded, 1 << color, runs[ color ], output[ names[ color ] ] );
+  }
+  
+} // uscauv
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *  test/test_lookup_table.cpp
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#include <uscauv_common/lookup_table.h>
+
+#include <gtest/gtest.h>
+
+typedef uscauv::LookupTable<double, double> _LookupTable;
+
+/// thruster with a deadband between -10 and 10 power
+static _LookupTable deadbandTable()
+{
+  return _LookupTable( { -100, -10, 10, 100 }, { -30, 0, 0, 30 } );
+}
+
+TEST( LookupTable, linearInterpolation )
+{
+  _LookupTable const table = deadbandTable();
+
+  EXPECT_DOUBLE_EQ( -30, table.lookupLinear( -200 ) );
+  EXPECT_DOUBLE_EQ( 30, table.lookupLinear( 200 ) );
+  EXPECT_DOUBLE_EQ( 0, table.lookupLinear( 5 ) );
+  EXPECT_DOUBLE_EQ( 15, table.lookupLinear( 55 ) );
+}
+
+TEST( LookupTable, invertDeadband )
+{
+  _LookupTable inverse;
+  ASSERT_EQ( 0, deadbandTable().invert( inverse ) );
+
+  /// exact on both sides of the deadband
+  EXPECT_NEAR( 13, inverse.lookupLinear( 1 ), 1e-9 );
+  EXPECT_NEAR( 55, inverse.lookupLinear( 15 ), 1e-9 );
+  EXPECT_NEAR( -13, inverse.lookupLinear( -1 ), 1e-9 );
+  EXPECT_NEAR( -55, inverse.lookupLinear( -15 ), 1e-9 );
+
+  /// zero force is the middle of the deadband
+  EXPECT_DOUBLE_EQ( 0, inverse.lookupLinear( 0 ) );
+}
+
+TEST( LookupTable, invertDecreasingDeadband )
+{
+  _LookupTable const table( { -100, -10, 10, 100 }, { 30, 0, 0, -30 } );
+  _LookupTable inverse;
+  ASSERT_EQ( 0, table.invert( inverse ) );
+
+  EXPECT_NEAR( -13, inverse.lookupLinear( 1 ), 1e-9 );
+  EXPECT_NEAR( 55, inverse.lookupLinear( -15 ), 1e-9 );
+  EXPECT_DOUBLE_EQ( 0, inverse.lookupLinear( 0 ) );
+}
+
+TEST( LookupTable, invertRoundTrip )
+{
+  _LookupTable const table = deadbandTable();
+  _LookupTable inverse;
+  ASSERT_EQ( 0, table.invert( inverse ) );
+
+  for( double force = -30; force <= 30; force += 0.5 )
+    EXPECT_NEAR( force, table.lookupLinear( inverse.lookupLinear( force ) ), 1e-9 );
+}
+
+TEST( LookupTable, invertNotMonotone )
+{
+  _LookupTable const table( { 0, 1, 2 }, { 0, 1, 0 } );
+  _LookupTable inverse;
+  EXPECT_EQ( -1, table.invert( inverse ) );
+}
+
+int main( int argc, char ** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}
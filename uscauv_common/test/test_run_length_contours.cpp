@@ -0,0 +1,197 @@
+/***************************************************************************
+ *  uscauv_common/test/test_run_length_contours.cpp
+ *  --------------------
+ *
+ *  Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2013, Dylan Foster (turtlecannon@gmail.com)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following disclaimer
+ *    in the documentation and/or other materials provided with the
+ *    distribution.
+ *  * Neither the name of USC AUV nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+
+#include <uscauv_common/run_length_contours.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+/// outer border or hole, and the border's pixels in sorted order
+typedef std::pair<bool, std::vector<std::pair<int, int> > > _BorderKey;
+/// each border mapped to the border of its parent
+typedef std::map<_BorderKey, _BorderKey> _BorderTree;
+
+/// Order-independent form of a contour tree, since contour order and border starting points are free to differ
+static _BorderTree borderTree( std::vector<std::vector<cv::Point> > const & contours,
+			       std::vector<cv::Vec4i> const & hierarchy )
+{
+  std::vector<_BorderKey> keys( contours.size() );
+  for( size_t idx = 0; idx < contours.size(); ++idx )
+    {
+      int depth = 0;
+      for( int parent = hierarchy[ idx ][ 3 ]; parent >= 0; parent = hierarchy[ parent ][ 3 ] )
+	++depth;
+      
+      keys[ idx ].first = depth % 2;
+      for( std::vector<cv::Point>::const_iterator point_it = contours[ idx ].begin();
+	   point_it != contours[ idx ].end(); ++point_it )
+	keys[ idx ].second.push_back( std::make_pair( point_it->x, point_it->y ) );
+      
+      std::sort( keys[ idx ].second.begin(), keys[ idx ].second.end() );
+      keys[ idx ].second.erase( std::unique( keys[ idx ].second.begin(), keys[ idx ].second.end() ),
+				keys[ idx ].second.end() );
+    }
+  
+  _BorderTree tree;
+  for( size_t idx = 0; idx < contours.size(); ++idx )
+    {
+      int const parent = hierarchy[ idx ][ 3 ];
+      tree[ keys[ idx ] ] = parent >= 0 ? keys[ parent ] : _BorderKey();
+    }
+  /// every border has to be distinguishable for the comparison to mean anything
+  EXPECT_EQ( contours.size(), tree.size() );
+  return tree;
+}
+
+/// Compare findColorContours() against cv::findContours() on each color's mask
+static void expectMatchesFindContours( cv::Mat const & encoded, std::vector<std::string> const & names )
+{
+  uscauv::ColorContourMap color_contours;
+  uscauv::findColorContours( encoded, names, color_contours );
+  ASSERT_EQ( names.size(), color_contours.size() );
+  
+  for( size_t bit = 0; bit < names.size(); ++bit )
+    {
+      cv::Mat mask = cv::Mat::zeros( encoded.rows, encoded.cols, CV_8UC1 );
+      for( int y = 0; y < encoded.rows; ++y )
+	for( int x = 0; x < encoded.cols; ++x )
+	  if( encoded.at<unsigned short>( y, x ) & ( 1 << bit ) )
+	    mask.at<unsigned char>( y, x ) = 255;
+      
+      std::vector<std::vector<cv::Point> > contours;
+      std::vector<cv::Vec4i> hierarchy;
+      cv::findContours( mask, contours, hierarchy, CV_RETR_TREE, CV_CHAIN_APPROX_NONE );
+      
+      uscauv::ContourSet const & contour_set = color_contours[ names[ bit ] ];
+      ASSERT_EQ( contours.size(), contour_set.contours_.size() ) << "color " << names[ bit ];
+      ASSERT_EQ( contour_set.contours_.size(), contour_set.hierarchy_.size() );
+      EXPECT_TRUE( borderTree( contours, hierarchy ) ==
+		   borderTree( contour_set.contours_, contour_set.hierarchy_ ) ) << "color " << names[ bit ];
+    }
+}
+
+/// '.' is empty, 'r' and 'g' set one color bit each and 'y' sets both
+static cv::Mat encodeRows( std::vector<std::string> const & rows )
+{
+  cv::Mat encoded = cv::Mat::zeros( rows.size(), rows[0].size(), CV_16UC1 );
+  for( int y = 0; y < encoded.rows; ++y )
+    for( int x = 0; x < encoded.cols; ++x )
+      {
+	char const pixel = rows[ y ][ x ];
+	encoded.at<unsigned short>( y, x ) = ( pixel == 'r' || pixel == 'y' ) | ( pixel == 'g' || pixel == 'y' ) << 1;
+      }
+  return encoded;
+}
+
+static std::vector<std::string> const COLORS = { "red", "green" };
+
+TEST( RunLengthContours, sampleMasks )
+{
+  /// blob, ring around a hole with an island in it, diagonal chains and lone pixels, with the frame left clear
+  expectMatchesFindContours( encodeRows( { "..................",
+					   ".rrr....yyyyyyy...",
+					   ".rrrr...y.....y.r.",
+					   "..rr....y.rrr.y...",
+					   "........y.r.r.y.g.",
+					   ".g.g....y.rrr.y...",
+					   "..g.....y.....y.r.",
+					   ".g.g....yyyyyyy...",
+					   "....g...........g.",
+					   ".....g..gggg.r.r..",
+					   "........g..g..r...",
+					   ".r......gggg.r.r..",
+					   ".................." } ), COLORS );
+  
+  /// holes that only touch diagonally are separate, islands that touch diagonally are one
+  expectMatchesFindContours( encodeRows( { "..........",
+					   ".rrrrrrrr.",
+					   ".r.rr.r.r.",
+					   ".rr..r.rr.",
+					   ".rr..rrrr.",
+					   ".rrrrrrrr.",
+					   ".........." } ), COLORS );
+}
+
+TEST( RunLengthContours, randomMasks )
+{
+  cv::RNG rng( 0x5eab33 );
+  for( int trial = 0; trial < 200; ++trial )
+    {
+      int const rows = rng.uniform( 1, 32 );
+      int const cols = rng.uniform( 1, 32 );
+      int const density = rng.uniform( 0, 100 );
+      
+      cv::Mat encoded = cv::Mat::zeros( rows, cols, CV_16UC1 );
+      for( int y = 1; y < rows - 1; ++y )
+	for( int x = 1; x < cols - 1; ++x )
+	  encoded.at<unsigned short>( y, x ) = ( rng.uniform( 0, 100 ) < density ) | ( rng.uniform( 0, 100 ) < density ) << 1;
+      
+      SCOPED_TRACE( trial );
+      expectMatchesFindContours( encoded, COLORS );
+    }
+}
+
+/// where findContours would see background, the frame pixels are part of the shape
+TEST( RunLengthContours, frameIsForeground )
+{
+  uscauv::ColorContourMap color_contours;
+  uscauv::findColorContours( encodeRows( { "rrrr",
+					   "rrrr",
+					   "rrrr" } ), COLORS, color_contours );
+  
+  uscauv::ContourSet const & red = color_contours[ "red" ];
+  ASSERT_EQ( 1U, red.contours_.size() );
+  EXPECT_EQ( -1, red.hierarchy_[0][3] );
+  
+  std::vector<cv::Point> const & border = red.contours_[0];
+  EXPECT_EQ( 10U, border.size() );
+  EXPECT_NE( border.end(), std::find( border.begin(), border.end(), cv::Point( 0, 0 ) ) );
+  EXPECT_NE( border.end(), std::find( border.begin(), border.end(), cv::Point( 3, 2 ) ) );
+  
+  EXPECT_TRUE( color_contours[ "green" ].contours_.empty() );
+}
+
+int main( int argc, char ** argv )
+{
+  testing::InitGoogleTest( &argc, argv );
+  return RUN_ALL_TESTS();
+}